@@ -2,9 +2,15 @@
 #include <Fusion/FusionAll.h>
 
 #include <sstream>
+#include <unordered_map>
+#include <vector>
 #define _USE_MATH_DEFINES
 #include <math.h>
 
+#include "DirectBody.h"
+#include "LighteningCells.h"
+#include "ToleranceOffset.h"
+
 using namespace adsk::core;
 using namespace adsk::fusion;
 
@@ -68,7 +74,8 @@ namespace {
 	}
 
 
-	Ptr<ExtrudeFeature> createExtrude(Ptr<Profile> prof, double thickness, bool cut)
+	// prof is a single profile or an ObjectCollection of profiles.
+	Ptr<ExtrudeFeature> createExtrude(Ptr<Base> prof, double thickness, bool cut)
 	{
 		if (!newComp)
 			return nullptr;
@@ -86,18 +93,156 @@ namespace {
 		return extrudes->add(extInput);
 	}
 
-	// Construct a lightening Cylinder
-	void buildLighteningCylinder(double innerDiameter, double outerDiameter, double thicknessY, double thicknessZ, int numSupport)
+	// Draw a closed polygon with connected lines.
+	void drawPolygon(Ptr<SketchLines> lines, const Polygon2& poly)
+	{
+		Ptr<SketchLine> firstLine;
+		Ptr<SketchLine> prevLine;
+		for (size_t i = 1; i < poly.size(); ++i)
+		{
+			Ptr<Point3D> endPoint = Point3D::create(poly[i].x, poly[i].y, 0);
+			if (prevLine)
+				prevLine = lines->addByTwoPoints(prevLine->endSketchPoint(), endPoint);
+			else
+				prevLine = firstLine = lines->addByTwoPoints(Point3D::create(poly[0].x, poly[0].y, 0), endPoint);
+		}
+		if (firstLine)
+			lines->addByTwoPoints(prevLine->endSketchPoint(), firstLine->startSketchPoint());
+	}
+
+	// Parameters which fully determine the geometry of a lightening cylinder.
+	struct CylinderSpec
+	{
+		double innerDiameter;
+		double outerDiameter;
+		double thicknessY;
+		double thicknessZ;
+		int numSupport;
+		LighteningPattern pattern;
+		double cellSize;
+		double minWall;
+		std::string process;
+		BuildMode buildMode;
+
+		bool operator==(const CylinderSpec& other) const
+		{
+			return innerDiameter == other.innerDiameter && outerDiameter == other.outerDiameter &&
+				thicknessY == other.thicknessY && thicknessZ == other.thicknessZ && numSupport == other.numSupport &&
+				pattern == other.pattern && cellSize == other.cellSize && minWall == other.minWall &&
+				process == other.process && buildMode == other.buildMode;
+		}
+	};
+
+	struct CylinderSpecHash
+	{
+		size_t operator()(const CylinderSpec& spec) const
+		{
+			size_t h = std::hash<double>()(spec.innerDiameter);
+			h = h * 31 + std::hash<double>()(spec.outerDiameter);
+			h = h * 31 + std::hash<double>()(spec.thicknessY);
+			h = h * 31 + std::hash<double>()(spec.thicknessZ);
+			h = h * 31 + std::hash<int>()(spec.numSupport);
+			h = h * 31 + std::hash<int>()(spec.pattern);
+			h = h * 31 + std::hash<double>()(spec.cellSize);
+			h = h * 31 + std::hash<double>()(spec.minWall);
+			h = h * 31 + std::hash<std::string>()(spec.process);
+			h = h * 31 + std::hash<int>()(spec.buildMode);
+			return h;
+		}
+	};
+
+	// Components already built, keyed by their spec.
+	std::unordered_map<CylinderSpec, Ptr<Component>, CylinderSpecHash> cylinderRegistry;
+
+	// Add an occurrence of an already built cylinder with the same spec.
+	// Returns false if there is no such cylinder in the design.
+	bool instanceCylinder(const CylinderSpec& spec, Ptr<Design> design)
+	{
+		auto it = cylinderRegistry.find(spec);
+		if (it == cylinderRegistry.end())
+			return false;
+
+		// The component may have been deleted, or belong to another document.
+		Ptr<Component> comp = it->second;
+		if (!comp || !comp->isValid() || comp->parentDesign().get() != design.get())
+		{
+			cylinderRegistry.erase(it);
+			return false;
+		}
+
+		Ptr<Occurrences> allOccs = design->rootComponent()->occurrences();
+		return allOccs->addExistingComponent(comp, Matrix3D::create()) != nullptr;
+	}
+
+	// Construct a lightening Cylinder, offset for the manufacturing process.
+	// In direct mode the rings, spokes and cells are combined as B-rep bodies
+	// and committed without timeline features; in compact mode every spoke is
+	// drawn and extruded at once instead of patterned. The timeline items of a
+	// new cylinder are grouped together.
+	void buildLighteningCylinder(double innerDiameter, double outerDiameter, double thicknessY, double thicknessZ, int numSupport,
+		LighteningPattern pattern, double cellSize, double minWall, const ProcessTolerance& process, BuildMode buildMode)
 	{
 		//ui->messageBox("hello");
 
-		// Create new component
 		Ptr<Product> product = app->activeProduct();
 		Ptr<Design> design = product;
+
+		// Reuse the component if the same cylinder was built before.
+		CylinderSpec spec = { innerDiameter, outerDiameter, thicknessY, thicknessZ, numSupport, pattern, cellSize, minWall, process.name, buildMode };
+		if (instanceCylinder(spec, design))
+			return;
+
+		// Create new component
+		int groupStart = timelineStart(design);
 		Ptr<Component> rootComp = design->rootComponent();
 		Ptr<Occurrences> allOccs = rootComp->occurrences();
 		Ptr<Occurrence> newOcc = allOccs->addNewComponent(Matrix3D::create());
 		newComp = newOcc->component();
+		auto finish = [&]()
+		{
+			cylinderRegistry[spec] = newComp;
+			groupTimeline(design, groupStart, "Lightening Cylinder");
+		};
+
+		// The solid grows by the process offset, so the bore and the cells
+		// shrink while the rings and spokes widen.
+		double growth = solidGrowth(process);
+		double boreRadius = innerDiameter / 2.0 - growth;
+		double innerRingRadius = innerDiameter / 2.0 + thicknessY + growth;
+		double outerRingRadius = outerDiameter / 2.0 - thicknessY - growth;
+		double outsideRadius = outerDiameter / 2.0 + growth;
+		std::vector<Polygon2> spokes, cells;
+		if (pattern == SpokePattern)
+			spokes = spokeOutlines(innerDiameter / 2.0, outerDiameter / 2.0, thicknessY, numSupport, growth);
+		else
+			cells = offsetPolygons(computeLighteningCells(pattern, innerDiameter / 2.0 + thicknessY,
+				outerDiameter / 2.0 - thicknessY, cellSize, minWall), -growth);
+
+		if (buildMode == DirectBuildMode)
+		{
+			Ptr<TemporaryBRepManager> tempBRep = TemporaryBRepManager::get();
+			Ptr<BRepBody> body = cylinderBody(outsideRadius, thicknessZ);
+			tempBRep->booleanOperation(body, cylinderBody(boreRadius, thicknessZ), BooleanTypes::DifferenceBooleanType);
+
+			if (pattern == SpokePattern)
+			{
+				// Clear the band between the rings, then put the spokes back.
+				Ptr<BRepBody> band = cylinderBody(outerRingRadius, thicknessZ);
+				tempBRep->booleanOperation(band, cylinderBody(innerRingRadius, thicknessZ), BooleanTypes::DifferenceBooleanType);
+				tempBRep->booleanOperation(body, band, BooleanTypes::DifferenceBooleanType);
+				if (!spokes.empty())
+					tempBRep->booleanOperation(body, prismBody(spokes, thicknessZ), BooleanTypes::UnionBooleanType);
+			}
+			else if (!cells.empty())
+			{
+				// All cells are lumps of one tool body, so they are cut at once.
+				tempBRep->booleanOperation(body, prismBody(cells, thicknessZ), BooleanTypes::DifferenceBooleanType);
+			}
+
+			commitBody(newComp, body);
+			finish();
+			return;
+		}
 
 		// Create a new sketch.
 		Ptr<Sketches> sketches = newComp->sketches();
@@ -108,36 +253,79 @@ namespace {
 		// Draw circles.
 		Ptr<SketchCircles> circles = curves->sketchCircles();
 
-		Ptr<SketchCircle> circle1 = circles->addByCenterRadius(Point3D::create(0, 0, 0), innerDiameter / 2.0);
-		Ptr<SketchCircle> circle2 = circles->addByCenterRadius(Point3D::create(0, 0, 0), innerDiameter / 2.0 + thicknessY);
-		Ptr<SketchCircle> circle3 = circles->addByCenterRadius(Point3D::create(0, 0, 0), outerDiameter / 2.0 - thicknessY);
-		Ptr<SketchCircle> circle4 = circles->addByCenterRadius(Point3D::create(0, 0, 0), outerDiameter / 2.0);
+		Ptr<SketchCircle> circle1 = circles->addByCenterRadius(Point3D::create(0, 0, 0), boreRadius);
+		Ptr<SketchCircle> circle2 = circles->addByCenterRadius(Point3D::create(0, 0, 0), innerRingRadius);
+		Ptr<SketchCircle> circle3 = circles->addByCenterRadius(Point3D::create(0, 0, 0), outerRingRadius);
+		Ptr<SketchCircle> circle4 = circles->addByCenterRadius(Point3D::create(0, 0, 0), outsideRadius);
 
 		
 		// Create the extrusion.
 		Ptr<Profiles> profs = sketch->profiles();
 
-		Ptr<Profile> profOne1 = profs->item(1);
-		Ptr<ExtrudeFeature> extOne1 = createExtrude(profOne1, thicknessZ,0);
+		if (pattern != SpokePattern)
+		{
+			// Extrude the whole disc between the rings in one feature.
+			Ptr<ObjectCollection> discProfs = ObjectCollection::create();
+			discProfs->add(profs->item(1));
+			discProfs->add(profs->item(2));
+			discProfs->add(profs->item(3));
+			createExtrude(discProfs, thicknessZ, false);
+
+			// Draw every cell in one sketch and cut them at once.
+			if (!cells.empty())
+			{
+				Ptr<Sketch> cellSketch = sketches->add(xyPlane);
+				Ptr<SketchLines> cellLines = cellSketch->sketchCurves()->sketchLines();
+				cellSketch->isComputeDeferred(true);
+				for (const Polygon2& cell : cells)
+					drawPolygon(cellLines, cell);
+				cellSketch->isComputeDeferred(false);
+
+				Ptr<ObjectCollection> cellProfs = ObjectCollection::create();
+				for (Ptr<Profile> prof : cellSketch->profiles())
+					cellProfs->add(prof);
+				createExtrude(cellProfs, thicknessZ, true);
+			}
 
-		Ptr<Profile> profOne2 = profs->item(3);
-		Ptr<ExtrudeFeature> extOne2 = createExtrude(profOne2, thicknessZ,0);
+			finish();
+			return;
+		}
 
+		// Both rings in one feature.
+		Ptr<ObjectCollection> ringProfs = ObjectCollection::create();
+		ringProfs->add(profs->item(1));
+		ringProfs->add(profs->item(3));
+		Ptr<ExtrudeFeature> extOne1 = createExtrude(ringProfs, thicknessZ, false);
+
+		if (spokes.empty())
+		{
+			finish();
+			return;
+		}
 
 		// Draw rectangule
 		Ptr<Sketch> sketch2 = sketches->add(xyPlane);
 		Ptr<SketchCurves> curves2 = sketch2->sketchCurves();
 
-		double px1 = thicknessY / 2.0;
-		double px2 = -1 * thicknessY / 2.0;
-		double py1 = innerDiameter / 2.0 + 0.9*thicknessY;
-		double py2 = outerDiameter / 2.0 - 0.9*thicknessY;
-
 		Ptr<SketchLines> lines = curves2->sketchLines();
-		Ptr<SketchLine> line1 = lines->addByTwoPoints(Point3D::create(px1, py1, 0), Point3D::create(px1, py2, 0));
-		Ptr<SketchLine> line2 = lines->addByTwoPoints(Point3D::create(px1, py2, 0), Point3D::create(px2, py2, 0));
-		Ptr<SketchLine> line3 = lines->addByTwoPoints(Point3D::create(px2, py2, 0), Point3D::create(px2, py1, 0));
-		Ptr<SketchLine> line4 = lines->addByTwoPoints(Point3D::create(px2, py1, 0), Point3D::create(px1, py1, 0));
+		if (buildMode == CompactBuildMode)
+		{
+			// Every spoke in one sketch and one extrusion, without a pattern.
+			sketch2->isComputeDeferred(true);
+			for (const Polygon2& spoke : spokes)
+				drawPolygon(lines, spoke);
+			sketch2->isComputeDeferred(false);
+
+			Ptr<ObjectCollection> spokeProfs = ObjectCollection::create();
+			for (Ptr<Profile> prof : sketch2->profiles())
+				spokeProfs->add(prof);
+			createExtrude(spokeProfs, thicknessZ, false);
+
+			finish();
+			return;
+		}
+
+		drawPolygon(lines, spokes[0]);
 
 		// Create the extrusion
 		Ptr<Profiles> profs2 = sketch2->profiles();
@@ -149,6 +337,7 @@ namespace {
 		entities->add(extOne3);
 		patternTeeth(entities, extOne1, numSupport);
 
+		finish();
 	}
 
 	bool isPureNumber(std::string str)
@@ -183,14 +372,25 @@ public:
 		Ptr<ValueCommandInput> thicknessYInput = inputs->itemById("thicknessY");
 		Ptr<ValueCommandInput> thicknessZInput = inputs->itemById("thicknessZ");
 		Ptr<StringValueCommandInput> numSupportInput = inputs->itemById("numSupport");
+		Ptr<DropDownCommandInput> patternInput = inputs->itemById("pattern");
+		Ptr<ValueCommandInput> cellSizeInput = inputs->itemById("cellSize");
+		Ptr<ValueCommandInput> minWallInput = inputs->itemById("minWall");
+		Ptr<DropDownCommandInput> processInput = inputs->itemById("process");
+		Ptr<DropDownCommandInput> buildModeInput = inputs->itemById("buildMode");
 
 		double innerDiameter = 10.0;
 		double outerDiameter = 20.0;
 		double thicknessY = 2.0;
 		double thicknessZ = 2.0;
 		int numSupport = 3;
-
-		if (!innerDiameterInput || !outerDiameterInput || !thicknessYInput || !thicknessZInput || !numSupportInput)
+		LighteningPattern pattern = SpokePattern;
+		double cellSize = 1.0;
+		double minWall = 0.2;
+		const ProcessTolerance* process = &processPresets[0];
+		BuildMode buildMode = ParametricBuildMode;
+
+		if (!innerDiameterInput || !outerDiameterInput || !thicknessYInput || !thicknessZInput || !numSupportInput ||
+			!patternInput || !cellSizeInput || !minWallInput || !processInput || !buildModeInput)
 		{
 			ui->messageBox("One of the inputs don't exist.");
 		}
@@ -206,9 +406,23 @@ public:
 			{
 				numSupport = atoi(numSupportInputValue.c_str());
 			}
+
+			Ptr<ListItem> patternItem = patternInput->selectedItem();
+			if (patternItem)
+				pattern = patternFromName(patternItem->name());
+			cellSize = unitsMgr->evaluateExpression(cellSizeInput->expression(), "mm");
+			minWall = unitsMgr->evaluateExpression(minWallInput->expression(), "mm");
+
+			Ptr<ListItem> processItem = processInput->selectedItem();
+			if (processItem)
+				process = &processFromName(processItem->name());
+			Ptr<ListItem> buildModeItem = buildModeInput->selectedItem();
+			if (buildModeItem)
+				buildMode = buildModeFromName(buildModeItem->name());
 		}
 
-		buildLighteningCylinder(innerDiameter, outerDiameter, thicknessY, thicknessZ, numSupport);
+		buildLighteningCylinder(innerDiameter, outerDiameter, thicknessY, thicknessZ, numSupport, pattern, cellSize, minWall,
+			*process, buildMode);
 
 	}
 };
@@ -229,8 +443,13 @@ public:
 		Ptr<ValueCommandInput> thicknessYInput = inputs->itemById("thicknessY");
 		Ptr<ValueCommandInput> thicknessZInput = inputs->itemById("thicknessZ");
 		Ptr<StringValueCommandInput> numSupportInput = inputs->itemById("numSupport");
+		Ptr<DropDownCommandInput> patternInput = inputs->itemById("pattern");
+		Ptr<ValueCommandInput> cellSizeInput = inputs->itemById("cellSize");
+		Ptr<ValueCommandInput> minWallInput = inputs->itemById("minWall");
+		Ptr<DropDownCommandInput> processInput = inputs->itemById("process");
 
-		if (!innerDiameterInput || !outerDiameterInput || !thicknessYInput || !thicknessZInput || !numSupportInput)
+		if (!innerDiameterInput || !outerDiameterInput || !thicknessYInput || !thicknessZInput || !numSupportInput ||
+			!patternInput || !cellSizeInput || !minWallInput || !processInput)
 			return;
 
 		if (!app)
@@ -248,8 +467,24 @@ public:
 		{
 			numSupport = atoi(numSupportInputValue.c_str());
 		}
-
-		if (innerDiameter <= 0 || outerDiameter <= 0 || thicknessY <= 0 || thicknessZ < 0 || numSupport < 2)
+		Ptr<ListItem> patternItem = patternInput->selectedItem();
+		LighteningPattern pattern = patternItem ? patternFromName(patternItem->name()) : SpokePattern;
+		double cellSize = unitsMgr->evaluateExpression(cellSizeInput->expression(), "mm");
+		double minWall = unitsMgr->evaluateExpression(minWallInput->expression(), "mm");
+		Ptr<ListItem> processItem = processInput->selectedItem();
+		const ProcessTolerance& process = processFromName(processItem ? processItem->name() : "");
+
+		if (innerDiameter <= 0 || outerDiameter <= 0 || thicknessY <= 0 || thicknessZ < 0)
+			eventArgs->areInputsValid(false);
+		else if (!wallHolds(thicknessY, process))
+			eventArgs->areInputsValid(false);
+		else if (pattern == SpokePattern && numSupport < 2)
+			eventArgs->areInputsValid(false);
+		else if (pattern == SpokePattern && spokeRingOverlap * thicknessY + solidGrowth(process) <= 0)
+			eventArgs->areInputsValid(false);
+		else if (pattern != SpokePattern && (minWall <= 0 || cellSize <= 2 * minWall))
+			eventArgs->areInputsValid(false);
+		else if (pattern != SpokePattern && !wallHolds(minWall, process))
 			eventArgs->areInputsValid(false);
 		else
 			eventArgs->areInputsValid(true);
@@ -306,6 +541,32 @@ public:
 
 				inputs->addStringValueInput("numSupport", "Number of Support Material", "3");
 
+				Ptr<DropDownCommandInput> patternInput = inputs->addDropDownCommandInput("pattern", "Lightening Pattern", DropDownStyles::TextListDropDownStyle);
+				Ptr<ListItems> patternItems = patternInput->listItems();
+				patternItems->add("Spokes", true);
+				patternItems->add("Triangle", false);
+				patternItems->add("Hex", false);
+				patternItems->add("Voronoi", false);
+
+				Ptr<ValueInput> initialVal5 = ValueInput::createByReal(0.08);
+				inputs->addValueInput("cellSize", "Cell Size", "mm", initialVal5);
+
+				Ptr<ValueInput> initialVal6 = ValueInput::createByReal(0.02);
+				inputs->addValueInput("minWall", "Minimum Wall Thickness", "mm", initialVal6);
+
+				// Kerf and shrinkage allowances of the manufacturing process.
+				Ptr<DropDownCommandInput> processInput = inputs->addDropDownCommandInput("process", "Process", DropDownStyles::TextListDropDownStyle);
+				Ptr<ListItems> processItems = processInput->listItems();
+				for (const ProcessTolerance& preset : processPresets)
+					processItems->add(preset.name, &preset == &processPresets[0]);
+
+				// Direct mode builds the cylinder as one body without parametric features.
+				Ptr<DropDownCommandInput> buildModeInput = inputs->addDropDownCommandInput("buildMode", "Build Mode", DropDownStyles::TextListDropDownStyle);
+				Ptr<ListItems> buildModeItems = buildModeInput->listItems();
+				buildModeItems->add("Parametric", true);
+				buildModeItems->add("Compact", false);
+				buildModeItems->add("Direct", false);
+
 			}
 		}
 	}
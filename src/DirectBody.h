@@ -0,0 +1,443 @@
+#pragma once
+
+// Solids built as temporary B-rep bodies and committed in one step, so they
+// add no parametric features to the timeline, and grouping of the timeline
+// items a generated part leaves behind. Unlike the geometry headers this
+// needs the Fusion API.
+
+#include <Core/CoreAll.h>
+#include <Fusion/FusionAll.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "Geometry2D.h"
+
+enum BuildMode
+{
+	ParametricBuildMode,
+	CompactBuildMode, // parametric, with as few features as possible
+	DirectBuildMode
+};
+
+inline BuildMode buildModeFromName(const std::string& name)
+{
+	if (name == "Compact")
+		return CompactBuildMode;
+	return (name == "Direct") ? DirectBuildMode : ParametricBuildMode;
+}
+
+// A clamped B-spline of the given degree through values at increasing
+// parameters from 0 to 1. Knots are averaged from the parameters, and each
+// control point is the weighted sum of the values given by its row of weights.
+struct SplineFit
+{
+	int degree;
+	std::vector<double> knots;
+	std::vector<std::vector<double>> weights;
+};
+
+inline SplineFit fitSpline(const std::vector<double>& params, int maxDegree)
+{
+	int n = (int)params.size();
+	SplineFit fit;
+	fit.degree = std::min(maxDegree, n - 1);
+	int p = fit.degree;
+	fit.knots.assign(p + 1, 0.0);
+	for (int j = 1; j < n - p; ++j)
+	{
+		double sum = 0.0;
+		for (int i = j; i < j + p; ++i)
+			sum += params[i];
+		fit.knots.push_back(sum / p);
+	}
+	fit.knots.insert(fit.knots.end(), p + 1, 1.0);
+
+	// Basis functions at every parameter, by the Cox-de Boor recursion, next
+	// to an identity matrix that Gauss-Jordan elimination turns into the weights.
+	std::vector<std::vector<double>> rows(n, std::vector<double>(2 * n, 0.0));
+	for (int k = 0; k < n; ++k)
+	{
+		double t = params[k];
+		int span = p;
+		while (span < n - 1 && t >= fit.knots[span + 1])
+			++span;
+
+		std::vector<double> basis(p + 1, 0.0), left(p + 1, 0.0), right(p + 1, 0.0);
+		basis[0] = 1.0;
+		for (int d = 1; d <= p; ++d)
+		{
+			left[d] = t - fit.knots[span + 1 - d];
+			right[d] = fit.knots[span + d] - t;
+			double saved = 0.0;
+			for (int r = 0; r < d; ++r)
+			{
+				double temp = basis[r] / (right[r + 1] + left[d - r]);
+				basis[r] = saved + right[r + 1] * temp;
+				saved = left[d - r] * temp;
+			}
+			basis[d] = saved;
+		}
+		for (int r = 0; r <= p; ++r)
+			rows[k][span - p + r] = basis[r];
+		rows[k][n + k] = 1.0;
+	}
+
+	for (int col = 0; col < n; ++col)
+	{
+		int pivot = col;
+		for (int k = col + 1; k < n; ++k)
+		{
+			if (fabs(rows[k][col]) > fabs(rows[pivot][col]))
+				pivot = k;
+		}
+		std::swap(rows[col], rows[pivot]);
+
+		double scale = 1.0 / rows[col][col];
+		for (double& value : rows[col])
+			value *= scale;
+		for (int k = 0; k < n; ++k)
+		{
+			double factor = rows[k][col];
+			if (k == col || factor == 0.0)
+				continue;
+			for (int i = col; i < 2 * n; ++i)
+				rows[k][i] -= factor * rows[col][i];
+		}
+	}
+
+	for (std::vector<double>& row : rows)
+		fit.weights.push_back(std::vector<double>(row.begin() + n, row.end()));
+	return fit;
+}
+
+// Parameters from 0 to 1 spaced like the lengths between successive points.
+inline std::vector<double> chordParameters(const std::vector<std::vector<double>>& points)
+{
+	std::vector<double> params(1, 0.0);
+	for (size_t i = 1; i < points.size(); ++i)
+	{
+		double sum = 0.0;
+		for (size_t d = 0; d < points[i].size(); ++d)
+			sum += (points[i][d] - points[i - 1][d]) * (points[i][d] - points[i - 1][d]);
+		params.push_back(params.back() + sqrt(sum));
+	}
+	for (double& param : params)
+		param = (params.back() > 0) ? param / params.back() : 0.0;
+	return params;
+}
+
+// Add a closed lump to a body definition, stacked from counterclockwise
+// outlines with the same number of points. The outline is split at corners
+// that turn by more than smoothTurn; each run between corners becomes one
+// face through every layer of a segment, so a helical flank is a single
+// B-spline face. Segments end where the layers stop twisting the same way,
+// as at the middle of a herringbone gear. Straight runs between straight
+// layers stay planar.
+inline void addLayeredLump(adsk::core::Ptr<adsk::fusion::BRepBodyDefinition> bodyDef,
+	const std::vector<Polygon2>& layers, const std::vector<double>& heights, double smoothTurn)
+{
+	using namespace adsk::core;
+	using namespace adsk::fusion;
+
+	// Drop points that coincide with the one before in the first layer, and
+	// the same points of every other layer, so no edge has zero length.
+	const double eps = 1e-9;
+	const Polygon2& first = layers[0];
+	std::vector<size_t> keep;
+	for (size_t j = 0; j < first.size(); ++j)
+	{
+		const Point2& prev = keep.empty() ? first.back() : first[keep.back()];
+		if (fabs(first[j].x - prev.x) > eps || fabs(first[j].y - prev.y) > eps)
+			keep.push_back(j);
+	}
+	size_t n = keep.size();
+	size_t layerCount = layers.size();
+	if (n < 3 || layerCount < 2)
+		return;
+
+	auto point = [&](size_t k, size_t j) { return layers[k][keep[j % n]]; };
+
+	// Corners of the outline, the same in every layer.
+	std::vector<size_t> corners;
+	for (size_t j = 0; j < n; ++j)
+	{
+		Point2 a = point(0, j + n - 1), b = point(0, j), c = point(0, j + 1);
+		double turn = fabs(remainder(atan2(c.y - b.y, c.x - b.x) - atan2(b.y - a.y, b.x - a.x), 2 * M_PI));
+		if (turn > smoothTurn)
+			corners.push_back(j);
+	}
+	if (corners.empty())
+		corners.push_back(0);
+	size_t runCount = corners.size();
+	auto runEnd = [&](size_t r) { return (r + 1 < runCount) ? corners[r + 1] : corners[0] + n; };
+
+	auto sameLayer = [&](size_t k1, size_t k2)
+	{
+		for (size_t j : keep)
+		{
+			if (layers[k1][j].x != layers[k2][j].x || layers[k1][j].y != layers[k2][j].y)
+				return false;
+		}
+		return true;
+	};
+	auto twist = [&](size_t k)
+	{
+		Point2 a = point(k, 0), b = point(k + 1, 0);
+		return a.x * b.y - a.y * b.x;
+	};
+
+	// Layers where segments begin and end.
+	std::vector<size_t> bounds(1, 0);
+	for (size_t k = 1; k + 1 < layerCount; ++k)
+	{
+		if (sameLayer(k - 1, k) || sameLayer(k, k + 1) || twist(k - 1) * twist(k) <= 0)
+			bounds.push_back(k);
+	}
+	bounds.push_back(layerCount - 1);
+
+	auto toPoint = [](const std::vector<double>& xyz) { return Point3D::create(xyz[0], xyz[1], xyz[2]); };
+	auto combine = [&](const std::vector<double>& weights, const std::vector<std::vector<double>>& values)
+	{
+		std::vector<double> result(3, 0.0);
+		for (size_t i = 0; i < values.size(); ++i)
+		{
+			for (int d = 0; d < 3; ++d)
+				result[d] += weights[i] * values[i][d];
+		}
+		return result;
+	};
+
+	// Fits along each run, by the lengths in the first layer, and up through
+	// each segment, by height. Neighbouring faces share them, so their
+	// common edges are the same curve.
+	auto fitFor = [](const std::vector<double>& params) { return fitSpline(params, (params.size() == 2) ? 1 : 3); };
+	std::vector<SplineFit> runFits;
+	for (size_t r = 0; r < runCount; ++r)
+	{
+		std::vector<std::vector<double>> values;
+		for (size_t j = corners[r]; j <= runEnd(r); ++j)
+			values.push_back({ point(0, j).x, point(0, j).y });
+		runFits.push_back(fitFor(chordParameters(values)));
+	}
+	std::vector<SplineFit> segmentFits;
+	for (size_t s = 0; s + 1 < bounds.size(); ++s)
+	{
+		std::vector<std::vector<double>> values;
+		for (size_t k = bounds[s]; k <= bounds[s + 1]; ++k)
+			values.push_back({ heights[k] });
+		segmentFits.push_back(fitFor(chordParameters(values)));
+	}
+
+	// A line through two points, or a B-spline curve through more.
+	auto curveThrough = [&](const std::vector<std::vector<double>>& values, const SplineFit& fit) -> Ptr<Curve3D>
+	{
+		if (values.size() == 2)
+			return Line3D::create(toPoint(values[0]), toPoint(values[1]));
+
+		std::vector<Ptr<Point3D>> controlPoints;
+		for (const std::vector<double>& weights : fit.weights)
+			controlPoints.push_back(toPoint(combine(weights, values)));
+		return NurbsCurve3D::createNonRational(controlPoints, fit.degree, fit.knots, false);
+	};
+
+	// Grid of points of run r across the layers of segment s, by run point.
+	auto grid = [&](size_t s, size_t r)
+	{
+		std::vector<std::vector<std::vector<double>>> result;
+		for (size_t j = corners[r]; j <= runEnd(r); ++j)
+		{
+			std::vector<std::vector<double>> column;
+			for (size_t k = bounds[s]; k <= bounds[s + 1]; ++k)
+				column.push_back({ point(k, j).x, point(k, j).y, heights[k] });
+			result.push_back(column);
+		}
+		return result;
+	};
+
+	// Vertices at the corners of every segment boundary.
+	size_t boundCount = bounds.size();
+	std::vector<std::vector<Ptr<BRepVertexDefinition>>> vertices(boundCount);
+	for (size_t b = 0; b < boundCount; ++b)
+	{
+		for (size_t c : corners)
+			vertices[b].push_back(bodyDef->createVertexDefinition(Point3D::create(point(bounds[b], c).x, point(bounds[b], c).y, heights[bounds[b]])));
+	}
+
+	// Edges along each run at every boundary, and up each corner through
+	// every segment.
+	std::vector<std::vector<Ptr<BRepEdgeDefinition>>> around(boundCount), up(boundCount - 1);
+	for (size_t b = 0; b < boundCount; ++b)
+	{
+		for (size_t r = 0; r < runCount; ++r)
+		{
+			std::vector<std::vector<double>> values;
+			for (size_t j = corners[r]; j <= runEnd(r); ++j)
+				values.push_back({ point(bounds[b], j).x, point(bounds[b], j).y, heights[bounds[b]] });
+			around[b].push_back(bodyDef->createEdgeDefinitionByCurve(vertices[b][r], vertices[b][(r + 1) % runCount], curveThrough(values, runFits[r])));
+		}
+	}
+	for (size_t s = 0; s + 1 < boundCount; ++s)
+	{
+		for (size_t r = 0; r < runCount; ++r)
+		{
+			std::vector<std::vector<double>> values = grid(s, r)[0];
+			up[s].push_back(bodyDef->createEdgeDefinitionByCurve(vertices[s][r], vertices[s + 1][r], curveThrough(values, segmentFits[s])));
+		}
+	}
+
+	Ptr<BRepShellDefinition> shellDef = bodyDef->lumpDefinitions()->add()->shellDefinitions()->add();
+
+	// A face on the given surface, whose normal points out; each edge is
+	// walked backwards if its flag is set.
+	auto addFace = [&](Ptr<Surface> surface, const std::vector<Ptr<BRepEdgeDefinition>>& edges, const std::vector<bool>& reversed)
+	{
+		Ptr<BRepFaceDefinition> faceDef = shellDef->faceDefinitions()->add(surface, false);
+		Ptr<BRepCoEdgeDefinitions> coEdges = faceDef->loopDefinitions()->add()->bRepCoEdgeDefinitions();
+		for (size_t i = 0; i < edges.size(); ++i)
+			coEdges->add(edges[i], reversed[i]);
+	};
+
+	// Sides: u runs along the outline and v up through the layers, so the
+	// surface normal points out of a counterclockwise outline.
+	for (size_t s = 0; s + 1 < boundCount; ++s)
+	{
+		bool straight = (bounds[s + 1] == bounds[s] + 1) && sameLayer(bounds[s], bounds[s + 1]);
+		for (size_t r = 0; r < runCount; ++r)
+		{
+			size_t next = (r + 1) % runCount;
+			std::vector<Ptr<BRepEdgeDefinition>> edges = { around[s][r], up[s][next], around[s + 1][r], up[s][r] };
+			std::vector<bool> reversed = { false, false, true, true };
+			std::vector<std::vector<std::vector<double>>> points = grid(s, r);
+			if (straight && points.size() == 2)
+			{
+				Ptr<Point3D> a = toPoint(points[0][0]);
+				Ptr<Vector3D> normal = a->vectorTo(toPoint(points[1][0]))->crossProduct(Vector3D::create(0.0, 0.0, 1.0));
+				normal->normalize();
+				addFace(Plane::create(a, normal), edges, reversed);
+				continue;
+			}
+
+			const SplineFit& fitU = runFits[r];
+			const SplineFit& fitV = segmentFits[s];
+
+			// Fit along v for every run point, then along u for every row.
+			std::vector<std::vector<std::vector<double>>> columns;
+			for (const std::vector<std::vector<double>>& column : points)
+			{
+				std::vector<std::vector<double>> controls;
+				for (const std::vector<double>& weights : fitV.weights)
+					controls.push_back(combine(weights, column));
+				columns.push_back(controls);
+			}
+			std::vector<Ptr<Point3D>> controlPoints;
+			for (const std::vector<double>& weights : fitU.weights)
+			{
+				for (size_t v = 0; v < fitV.weights.size(); ++v)
+				{
+					std::vector<std::vector<double>> row;
+					for (const std::vector<std::vector<double>>& controls : columns)
+						row.push_back(controls[v]);
+					controlPoints.push_back(toPoint(combine(weights, row)));
+				}
+			}
+
+			Ptr<NurbsSurface> surface = NurbsSurface::create(fitU.degree, fitV.degree,
+				(int)fitU.weights.size(), (int)fitV.weights.size(), controlPoints, fitU.knots, fitV.knots,
+				std::vector<double>(), NurbsSurfaceProperties::OpenNurbsSurface, NurbsSurfaceProperties::OpenNurbsSurface);
+			addFace(surface, edges, reversed);
+		}
+	}
+
+	// Caps: the bottom is walked clockwise so it faces down.
+	std::vector<Ptr<BRepEdgeDefinition>> bottomEdges(around[0].rbegin(), around[0].rend());
+	addFace(Plane::create(Point3D::create(0.0, 0.0, heights[0]), Vector3D::create(0.0, 0.0, -1.0)),
+		bottomEdges, std::vector<bool>(runCount, true));
+	addFace(Plane::create(Point3D::create(0.0, 0.0, heights[layerCount - 1]), Vector3D::create(0.0, 0.0, 1.0)),
+		around[boundCount - 1], std::vector<bool>(runCount, false));
+}
+
+// Solid stacked from the outlines of its layers.
+inline adsk::core::Ptr<adsk::fusion::BRepBody> layeredBody(const std::vector<Polygon2>& layers, const std::vector<double>& heights,
+	double smoothTurn)
+{
+	adsk::core::Ptr<adsk::fusion::BRepBodyDefinition> bodyDef = adsk::fusion::BRepBodyDefinition::create();
+	addLayeredLump(bodyDef, layers, heights, smoothTurn);
+	return bodyDef->createBody();
+}
+
+// Prisms of the given height over any number of disjoint outlines, as one
+// body with a lump per outline.
+inline adsk::core::Ptr<adsk::fusion::BRepBody> prismBody(const std::vector<Polygon2>& outlines, double height)
+{
+	adsk::core::Ptr<adsk::fusion::BRepBodyDefinition> bodyDef = adsk::fusion::BRepBodyDefinition::create();
+	std::vector<double> heights = { 0.0, height };
+	for (Polygon2 outline : outlines)
+	{
+		if (polygonArea(outline) < 0)
+			std::reverse(outline.begin(), outline.end());
+		addLayeredLump(bodyDef, { outline, outline }, heights, 0.0);
+	}
+	return bodyDef->createBody();
+}
+
+// Cylinder on the XY plane around the Z axis.
+inline adsk::core::Ptr<adsk::fusion::BRepBody> cylinderBody(double radius, double height)
+{
+	using namespace adsk::core;
+	return adsk::fusion::TemporaryBRepManager::get()->createCylinderOrCone(
+		Point3D::create(0.0, 0.0, 0.0), radius, Point3D::create(0.0, 0.0, height), radius);
+}
+
+// Add a temporary body to a component. In a parametric design it goes into
+// a single base feature, which is never recomputed.
+inline adsk::core::Ptr<adsk::fusion::BRepBody> commitBody(adsk::core::Ptr<adsk::fusion::Component> comp,
+	adsk::core::Ptr<adsk::fusion::BRepBody> body)
+{
+	using namespace adsk::core;
+	using namespace adsk::fusion;
+
+	Ptr<Design> design = comp->parentDesign();
+	if (design->designType() == DesignTypes::DirectDesignType)
+		return comp->bRepBodies()->add(body);
+
+	Ptr<BaseFeature> baseFeature = comp->features()->baseFeatures()->add();
+	baseFeature->startEdit();
+	Ptr<BRepBody> result = comp->bRepBodies()->add(body, baseFeature);
+	baseFeature->finishEdit();
+	return result;
+}
+
+// Timeline index where the next feature will go, or -1 in a direct design.
+inline int timelineStart(adsk::core::Ptr<adsk::fusion::Design> design)
+{
+	if (design->designType() == adsk::fusion::DesignTypes::DirectDesignType)
+		return -1;
+	return design->timeline()->markerPosition();
+}
+
+// Collapse the timeline items added since start into one named group, so a
+// generated part is a single step to scrub past or undo.
+inline adsk::core::Ptr<adsk::fusion::TimelineGroup> groupTimeline(adsk::core::Ptr<adsk::fusion::Design> design,
+	int start, const std::string& name)
+{
+	using namespace adsk::core;
+	using namespace adsk::fusion;
+
+	if (start < 0)
+		return nullptr;
+
+	Ptr<Timeline> timeline = design->timeline();
+	int end = timeline->markerPosition() - 1;
+	if (end <= start)
+		return nullptr;
+
+	Ptr<TimelineGroup> group = timeline->timelineGroups()->add(start, end);
+	if (!group)
+		return nullptr;
+
+	group->name(name);
+	group->isCollapsed(true);
+	return group;
+}
@@ -0,0 +1,682 @@
+// Headless generator for the SpurGear and LighteningCylinder add-ins.
+//
+// Builds the same geometry without Fusion, so it can run on build farms.
+// Every spec is one line of key=value pairs, passed as an argument or read
+// from stdin when no spec is given on the command line:
+//
+//   gear dp=7.62 teeth=24 pa=20 thickness=2 type=helical helix=20 tol=0.001 process=fdm
+//   cylinder inner=1 outer=2 ring=0.2 height=0.2 pattern=hex cell=0.08 wall=0.02 process=laser
+//   train ratio=60 stages=2-5 teeth=8-120 dp=7.62 center=6 error=1e-6 results=10
+//
+// process picks the offset preset from ToleranceOffset.h, Nominal by default.
+//
+// A train spec searches for compound gear trains with the given ratio and
+// reports the best candidates, one line each.
+//
+// Lengths are in cm like the Fusion API, angles in degrees.
+//
+// usage: gear_generator [--format report|profile|mesh] [--out DIR] [--jobs N] [--store FILE] [SPEC...]
+//        gear_generator --bench
+//
+//   report   one summary line per spec on stdout (default)
+//   profile  one DXF per spec with the 2D outline, written to DIR
+//   mesh     one ASCII STL per gear, written to DIR
+//
+// --bench times involute sampling over a sweep of gears with libm and with
+// the numerics in InvoluteMath.h.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#include "GearProfile.h"
+#include "GearTrainSearch.h"
+#include "InvoluteMath.h"
+#include "LighteningCells.h"
+#include "ParallelFor.h"
+#include "ProfileStore.h"
+#include "ToleranceOffset.h"
+
+namespace {
+
+	enum OutputFormat
+	{
+		ReportFormat,
+		ProfileFormat,
+		MeshFormat
+	};
+
+	// Points on every tip and root arc of an outline.
+	const int arcSegments = 8;
+
+	// Defaults are the initial values of the add-in dialogs.
+	struct Spec
+	{
+		std::string text;
+		bool isGear = true;
+		bool isTrain = false;
+
+		double diametralPitch = 7.62;
+		int numTeeth = 24;
+		double pressureAngle = 20.0 * (M_PI / 180);
+		double thickness = 2.0;
+		GearType gearType = SpurGearType;
+		double helixAngle = 20.0 * (M_PI / 180);
+		double tolerance = 0.001;
+
+		double innerDiameter = 1.0;
+		double outerDiameter = 2.0;
+		double thicknessY = 0.2;
+		double thicknessZ = 0.2;
+		int numSupport = 3;
+		LighteningPattern pattern = SpokePattern;
+		double cellSize = 0.08;
+		double minWall = 0.02;
+
+		const ProcessTolerance* process = &processPresets[0];
+
+		GearTrainQuery train;
+	};
+
+	// The add-ins name their list items with a capital first letter.
+	std::string itemName(std::string value)
+	{
+		for (char& c : value)
+			c = (char)tolower(c);
+		if (!value.empty())
+			value[0] = (char)toupper(value[0]);
+		return value;
+	}
+
+	// Process presets are matched regardless of case.
+	const ProcessTolerance* processByName(const std::string& value)
+	{
+		for (const ProcessTolerance& process : processPresets)
+		{
+			std::string name = process.name;
+			if (name.size() == value.size() && std::equal(name.begin(), name.end(), value.begin(),
+				[](char a, char b) { return tolower(a) == tolower(b); }))
+				return &process;
+		}
+		return nullptr;
+	}
+
+	// Parse "low-high", or a single value for both.
+	void parseRange(const std::string& value, int& low, int& high)
+	{
+		size_t dash = value.find('-');
+		low = atoi(value.c_str());
+		high = (dash == std::string::npos) ? low : atoi(value.c_str() + dash + 1);
+	}
+
+	// Parse and validate a spec with the same rules as the add-in dialogs.
+	bool parseSpec(const std::string& text, Spec& spec, std::string& error)
+	{
+		spec.text = text;
+		std::istringstream in(text);
+		std::string kind;
+		in >> kind;
+		if (kind != "gear" && kind != "cylinder" && kind != "train")
+		{
+			error = "unknown spec kind '" + kind + "'";
+			return false;
+		}
+		spec.isGear = (kind == "gear");
+		spec.isTrain = (kind == "train");
+
+		std::string token;
+		while (in >> token)
+		{
+			size_t eq = token.find('=');
+			if (eq == std::string::npos)
+			{
+				error = "expected key=value, got '" + token + "'";
+				return false;
+			}
+			std::string key = token.substr(0, eq);
+			std::string value = token.substr(eq + 1);
+			double number = atof(value.c_str());
+
+			if (spec.isGear && key == "dp")
+				spec.diametralPitch = number;
+			else if (spec.isGear && key == "teeth")
+				spec.numTeeth = atoi(value.c_str());
+			else if (spec.isGear && key == "pa")
+				spec.pressureAngle = number * (M_PI / 180);
+			else if (spec.isGear && key == "thickness")
+				spec.thickness = number;
+			else if (spec.isGear && key == "type")
+				spec.gearType = gearTypeFromName(itemName(value));
+			else if (spec.isGear && key == "helix")
+				spec.helixAngle = number * (M_PI / 180);
+			else if (spec.isGear && key == "tol")
+				spec.tolerance = number;
+			else if (!spec.isTrain && key == "process")
+			{
+				spec.process = processByName(value);
+				if (!spec.process)
+				{
+					error = "unknown process '" + value + "'";
+					return false;
+				}
+			}
+			else if (spec.isTrain && key == "ratio")
+				spec.train.targetRatio = number;
+			else if (spec.isTrain && key == "stages")
+				parseRange(value, spec.train.minStages, spec.train.maxStages);
+			else if (spec.isTrain && key == "teeth")
+				parseRange(value, spec.train.minTeeth, spec.train.maxTeeth);
+			else if (spec.isTrain && key == "dp")
+				spec.train.diametralPitch = number;
+			else if (spec.isTrain && key == "center")
+				spec.train.maxCenterDistance = number;
+			else if (spec.isTrain && key == "error")
+				spec.train.maxError = number;
+			else if (spec.isTrain && key == "results")
+				spec.train.maxResults = (size_t)std::max(0, atoi(value.c_str()));
+			else if (spec.isTrain)
+			{
+				error = "unknown key '" + key + "' for " + kind;
+				return false;
+			}
+			else if (!spec.isGear && key == "inner")
+				spec.innerDiameter = number;
+			else if (!spec.isGear && key == "outer")
+				spec.outerDiameter = number;
+			else if (!spec.isGear && key == "ring")
+				spec.thicknessY = number;
+			else if (!spec.isGear && key == "height")
+				spec.thicknessZ = number;
+			else if (!spec.isGear && key == "supports")
+				spec.numSupport = atoi(value.c_str());
+			else if (!spec.isGear && key == "pattern")
+				spec.pattern = patternFromName(itemName(value));
+			else if (!spec.isGear && key == "cell")
+				spec.cellSize = number;
+			else if (!spec.isGear && key == "wall")
+				spec.minWall = number;
+			else
+			{
+				error = "unknown key '" + key + "' for " + kind;
+				return false;
+			}
+		}
+
+		bool valid = true;
+		if (spec.isTrain)
+		{
+			const GearTrainQuery& train = spec.train;
+			if (train.targetRatio <= 0 || train.minStages < 1 || train.maxStages > 5 || train.minStages > train.maxStages)
+				valid = false;
+			else if (train.minTeeth < 3 || train.maxTeeth < train.minTeeth || train.diametralPitch <= 0)
+				valid = false;
+			else if (train.maxCenterDistance < 0 || train.maxError < 0 || train.maxResults < 1)
+				valid = false;
+		}
+		else if (spec.isGear)
+		{
+			if (spec.numTeeth < 3 || spec.diametralPitch <= 0 || spec.thickness <= 0 || spec.pressureAngle < 0 || spec.pressureAngle > M_PI * 30 / 180)
+				valid = false;
+			else if (spec.gearType != SpurGearType && (spec.helixAngle <= 0 || spec.helixAngle > M_PI * 45 / 180 || spec.tolerance <= 0))
+				valid = false;
+		}
+		else
+		{
+			if (spec.innerDiameter <= 0 || spec.outerDiameter <= 0 || spec.thicknessY <= 0 || spec.thicknessZ < 0)
+				valid = false;
+			else if (!wallHolds(spec.thicknessY, *spec.process))
+				valid = false;
+			else if (spec.pattern == SpokePattern && spec.numSupport < 2)
+				valid = false;
+			else if (spec.pattern == SpokePattern && spokeRingOverlap * spec.thicknessY + solidGrowth(*spec.process) <= 0)
+				valid = false;
+			else if (spec.pattern != SpokePattern && (spec.minWall <= 0 || spec.cellSize <= 2 * spec.minWall))
+				valid = false;
+			else if (spec.pattern != SpokePattern && !wallHolds(spec.minWall, *spec.process))
+				valid = false;
+		}
+		if (!valid)
+			error = "parameters out of range";
+
+		return valid;
+	}
+
+	void writeFacet(std::ostream& out, double ax, double ay, double az, double bx, double by, double bz, double cx, double cy, double cz)
+	{
+		double ux = bx - ax, uy = by - ay, uz = bz - az;
+		double vx = cx - ax, vy = cy - ay, vz = cz - az;
+		double nx = uy * vz - uz * vy;
+		double ny = uz * vx - ux * vz;
+		double nz = ux * vy - uy * vx;
+		double len = sqrt(nx * nx + ny * ny + nz * nz);
+		if (len > 0)
+		{
+			nx /= len;
+			ny /= len;
+			nz /= len;
+		}
+
+		out << "facet normal " << nx << " " << ny << " " << nz << "\n"
+			<< "outer loop\n"
+			<< "vertex " << ax << " " << ay << " " << az << "\n"
+			<< "vertex " << bx << " " << by << " " << bz << "\n"
+			<< "vertex " << cx << " " << cy << " " << cz << "\n"
+			<< "endloop\nendfacet\n";
+	}
+
+	// Closed triangle mesh of a gear, stacking one outline per layer.
+	std::string gearMesh(const Spec& spec, const ToothProfile& profile)
+	{
+		std::vector<double> angles, heights;
+		gearLayers(spec.gearType, profile, spec.thickness, spec.helixAngle, spec.tolerance, angles, heights);
+
+		std::vector<Polygon2> layers;
+		for (double angle : angles)
+			layers.push_back(gearOutline(profile, spec.numTeeth, angle, arcSegments));
+
+		std::ostringstream out;
+		out.precision(9);
+		out << "solid gear\n";
+
+		size_t n = layers[0].size();
+		for (size_t k = 0; k + 1 < layers.size(); ++k)
+		{
+			const Polygon2& lower = layers[k];
+			const Polygon2& upper = layers[k + 1];
+			double z0 = heights[k];
+			double z1 = heights[k + 1];
+			for (size_t j = 0; j < n; ++j)
+			{
+				const Point2& a = lower[j];
+				const Point2& b = lower[(j + 1) % n];
+				const Point2& c = upper[(j + 1) % n];
+				const Point2& d = upper[j];
+				writeFacet(out, a.x, a.y, z0, b.x, b.y, z0, c.x, c.y, z1);
+				writeFacet(out, a.x, a.y, z0, c.x, c.y, z1, d.x, d.y, z1);
+			}
+		}
+
+		// The outline is star shaped around the axis, so the caps are fans.
+		const Polygon2& bottom = layers.front();
+		const Polygon2& top = layers.back();
+		double zTop = heights.back();
+		for (size_t j = 0; j < n; ++j)
+		{
+			const Point2& a = bottom[j];
+			const Point2& b = bottom[(j + 1) % n];
+			writeFacet(out, 0, 0, 0, b.x, b.y, 0, a.x, a.y, 0);
+
+			const Point2& c = top[j];
+			const Point2& d = top[(j + 1) % n];
+			writeFacet(out, 0, 0, zTop, c.x, c.y, zTop, d.x, d.y, zTop);
+		}
+
+		out << "endsolid gear\n";
+		return out.str();
+	}
+
+	void writeDxfPolyline(std::ostream& out, const Polygon2& poly)
+	{
+		out << "0\nPOLYLINE\n8\n0\n66\n1\n70\n1\n";
+		for (const Point2& pt : poly)
+			out << "0\nVERTEX\n8\n0\n10\n" << pt.x << "\n20\n" << pt.y << "\n";
+		out << "0\nSEQEND\n8\n0\n";
+	}
+
+	void writeDxfCircle(std::ostream& out, double radius)
+	{
+		out << "0\nCIRCLE\n8\n0\n10\n0\n20\n0\n40\n" << radius << "\n";
+	}
+
+	// Generate the output for one spec. Returns false with an error message
+	// if the requested format does not apply.
+	bool generate(const Spec& spec, const ToothProfile* profile, OutputFormat format, size_t jobs, std::string& output)
+	{
+		std::ostringstream out;
+		out.precision(9);
+
+		if (spec.isTrain)
+		{
+			if (format != ReportFormat)
+			{
+				output = "train output is only available as a report";
+				return false;
+			}
+
+			std::vector<GearTrain> trains = searchGearTrains(spec.train, jobs);
+			if (trains.empty())
+			{
+				output = "no gear train within the constraints";
+				return false;
+			}
+
+			for (const GearTrain& train : trains)
+			{
+				out << "train ratio=" << train.ratio
+					<< " error=" << train.error
+					<< " stages=" << train.stages.size()
+					<< " parts=" << 2 * train.stages.size()
+					<< " size=" << train.size
+					<< " teeth=";
+				for (size_t i = 0; i < train.stages.size(); ++i)
+					out << (i ? "," : "") << train.stages[i].pinionTeeth << ":" << train.stages[i].wheelTeeth;
+				out << "\n";
+			}
+
+			output = out.str();
+			return true;
+		}
+
+		if (spec.isGear)
+		{
+			if (format == ReportFormat)
+			{
+				std::vector<double> angles, heights;
+				gearLayers(spec.gearType, *profile, spec.thickness, spec.helixAngle, spec.tolerance, angles, heights);
+				// Measured on the tooth as cut, after the process offset. The
+				// tooth is centered on the x axis, so the end of the flank is
+				// half the tip. Near the tip the offset flank is still an
+				// involute of the base circle, turned by the offset, so the
+				// tip fixes where the flanks would meet.
+				double baseRadius = profile->baseCircleDiameter / 2;
+				double tipRadius = profile->outsideDia / 2;
+				const Point2& tip = profile->involute[involutePointCount - 1];
+				double tipThicknessAngle = 2 * fabs(atan2(tip.y, tip.x));
+				double tipThickness = tipThicknessAngle * tipRadius;
+				double pitchThicknessAngle = tipThicknessAngle - 2 * (involute(spec.pressureAngle) - involutePolarAngle(baseRadius, tipRadius));
+				double pointedDia = 2 * pointedToothRadius(baseRadius, pitchThicknessAngle, spec.pressureAngle);
+
+				out << "gear teeth=" << spec.numTeeth
+					<< " pitch_dia=" << profile->pitchDia
+					<< " root_dia=" << profile->rootDiameter
+					<< " base_dia=" << profile->baseCircleDiameter
+					<< " outside_dia=" << profile->outsideDia
+					<< " tip_thickness=" << tipThickness
+					<< " pointed_dia=" << pointedDia
+					<< " sections=" << angles.size() << "\n";
+			}
+			else if (format == ProfileFormat)
+			{
+				out << "0\nSECTION\n2\nENTITIES\n";
+				writeDxfPolyline(out, gearOutline(*profile, spec.numTeeth, 0.0, arcSegments));
+				out << "0\nENDSEC\n0\nEOF\n";
+			}
+			else
+			{
+				out << gearMesh(spec, *profile);
+			}
+
+			output = out.str();
+			return true;
+		}
+
+		if (format == MeshFormat)
+		{
+			output = "mesh output is only available for gears";
+			return false;
+		}
+
+		// The solid grows by the process offset, as in the add-in.
+		double growth = solidGrowth(*spec.process);
+		double innerRadius = spec.innerDiameter / 2.0;
+		double outerRadius = spec.outerDiameter / 2.0;
+		double innerRingRadius = innerRadius + spec.thicknessY + growth;
+		double outerRingRadius = outerRadius - spec.thicknessY - growth;
+		std::vector<Polygon2> cells = offsetPolygons(computeLighteningCells(spec.pattern, innerRadius + spec.thicknessY,
+			outerRadius - spec.thicknessY, spec.cellSize, spec.minWall), -growth);
+
+		if (format == ReportFormat)
+		{
+			double bandArea = M_PI * (outerRingRadius * outerRingRadius - innerRingRadius * innerRingRadius);
+			double removedArea = 0.0;
+			for (const Polygon2& cell : cells)
+				removedArea += fabs(polygonArea(cell));
+
+			out << "cylinder pattern=" << ((spec.pattern == SpokePattern) ? "spokes" : "cells");
+			if (spec.pattern == SpokePattern)
+				out << " supports=" << spec.numSupport << "\n";
+			else
+				out << " cells=" << cells.size() << " removed=" << (bandArea > 0 ? 100.0 * removedArea / bandArea : 0.0) << "%\n";
+		}
+		else
+		{
+			out << "0\nSECTION\n2\nENTITIES\n";
+			writeDxfCircle(out, innerRadius - growth);
+			writeDxfCircle(out, outerRadius + growth);
+			if (spec.pattern == SpokePattern)
+			{
+				writeDxfCircle(out, innerRingRadius);
+				writeDxfCircle(out, outerRingRadius);
+				for (const Polygon2& spoke : spokeOutlines(innerRadius, outerRadius, spec.thicknessY, spec.numSupport, growth))
+					writeDxfPolyline(out, spoke);
+			}
+			for (const Polygon2& cell : cells)
+				writeDxfPolyline(out, cell);
+			out << "0\nENDSEC\n0\nEOF\n";
+		}
+
+		output = out.str();
+		return true;
+	}
+
+	// Involute point as the add-in computed it before InvoluteMath.h.
+	Point2 libmInvolutePoint(double baseCircleRadius, double distFromCenterToInvolutePoint)
+	{
+		double l = sqrt(distFromCenterToInvolutePoint * distFromCenterToInvolutePoint - baseCircleRadius * baseCircleRadius);
+		double alpha = l / baseCircleRadius;
+		double theta = alpha - acos(baseCircleRadius / distFromCenterToInvolutePoint);
+
+		return { distFromCenterToInvolutePoint * cos(theta), distFromCenterToInvolutePoint * sin(theta) };
+	}
+
+	// Sample the flanks of every gear with 6 to 200 teeth at four pressure
+	// angles, and return the time taken in seconds.
+	template <typename PointFunc>
+	double involuteSweep(const PointFunc& pointFunc, std::vector<Point2>& points)
+	{
+		const int samples = 64;
+		const double pressureAngles[] = { 14.5, 20.0, 25.0, 30.0 };
+
+		points.resize(4 * 195 * samples);
+		Point2* point = points.data();
+		auto start = std::chrono::steady_clock::now();
+		for (double pressureAngle : pressureAngles)
+		{
+			for (int numTeeth = 6; numTeeth <= 200; ++numTeeth)
+			{
+				double baseRadius = numTeeth * cos(pressureAngle * (M_PI / 180)) / 2;
+				double outsideRadius = (numTeeth + 2) / 2.0;
+				for (int i = 0; i < samples; ++i)
+					*point++ = pointFunc(baseRadius, baseRadius + (outsideRadius - baseRadius) * i / (samples - 1));
+			}
+		}
+
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	int bench()
+	{
+		const int rounds = 50;
+		std::vector<Point2> reference, fast;
+		double libmTime = 0.0, fastTime = 0.0;
+		for (int round = 0; round < rounds; ++round)
+		{
+			libmTime += involuteSweep([](double rb, double r) { return libmInvolutePoint(rb, r); }, reference);
+			fastTime += involuteSweep([](double rb, double r) { return involutePoint(rb, r); }, fast);
+		}
+
+		double maxError = 0.0;
+		for (size_t i = 0; i < reference.size(); ++i)
+			maxError = std::max(maxError, std::max(fabs(reference[i].x - fast[i].x), fabs(reference[i].y - fast[i].y)));
+
+		double count = (double)reference.size() * rounds;
+		printf("involute points: %zu per sweep, %d sweeps\n", reference.size(), rounds);
+		printf("libm: %.2f ns/point\n", 1e9 * libmTime / count);
+		printf("fast: %.2f ns/point\n", 1e9 * fastTime / count);
+		printf("speedup: %.2fx, max difference: %.3g\n", libmTime / fastTime, maxError);
+		return 0;
+	}
+
+	void usage()
+	{
+		std::cerr << "usage: gear_generator [--format report|profile|mesh] [--out DIR] [--jobs N] [--store FILE] [SPEC...]\n"
+			<< "       gear_generator --bench\n"
+			<< "  SPEC is 'gear key=value...', 'cylinder key=value...' or 'train key=value...';\n"
+			<< "  read from stdin if none is given.\n";
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	OutputFormat format = ReportFormat;
+	std::string outDir = ".";
+	std::string storePath;
+	size_t jobs = 0;
+	std::vector<std::string> lines;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool hasValue = (i + 1 < argc);
+		if (arg == "--format" && hasValue)
+		{
+			std::string value = argv[++i];
+			if (value == "report")
+				format = ReportFormat;
+			else if (value == "profile")
+				format = ProfileFormat;
+			else if (value == "mesh")
+				format = MeshFormat;
+			else
+			{
+				usage();
+				return 2;
+			}
+		}
+		else if (arg == "--out" && hasValue)
+			outDir = argv[++i];
+		else if (arg == "--jobs" && hasValue)
+			jobs = (size_t)std::max(0, atoi(argv[++i]));
+		else if (arg == "--store" && hasValue)
+			storePath = argv[++i];
+		else if (arg == "--bench")
+			return bench();
+		else if (arg.compare(0, 2, "--") == 0)
+		{
+			usage();
+			return 2;
+		}
+		else
+			lines.push_back(arg);
+	}
+
+	if (lines.empty())
+	{
+		std::string line;
+		while (std::getline(std::cin, line))
+		{
+			if (line.find_first_not_of(" \t\r") != std::string::npos && line[line.find_first_not_of(" \t")] != '#')
+				lines.push_back(line);
+		}
+	}
+
+	std::vector<Spec> specs(lines.size());
+	int status = 0;
+	for (size_t i = 0; i < lines.size(); ++i)
+	{
+		std::string error;
+		if (!parseSpec(lines[i], specs[i], error))
+		{
+			std::cerr << "spec " << (i + 1) << ": " << error << "\n";
+			return 2;
+		}
+	}
+
+	// Tooth profiles go through the store one at a time; the store is not
+	// shared between threads.
+	ProfileStore store;
+	if (!storePath.empty() && !store.open(storePath))
+		std::cerr << "warning: cannot open profile store " << storePath << "\n";
+
+	std::vector<ToothProfile> computed(specs.size());
+	std::vector<const ToothProfile*> profiles(specs.size(), nullptr);
+	parallelFor(specs.size(), [&](size_t i)
+	{
+		if (specs[i].isGear && storePath.empty())
+		{
+			computed[i] = computeToothProfile(specs[i].diametralPitch, specs[i].numTeeth, specs[i].pressureAngle);
+			profiles[i] = &computed[i];
+		}
+	}, 16, jobs);
+	for (size_t i = 0; i < specs.size(); ++i)
+	{
+		if (!specs[i].isGear || profiles[i])
+			continue;
+		profiles[i] = store.find(specs[i].diametralPitch, specs[i].numTeeth, specs[i].pressureAngle);
+		if (!profiles[i])
+		{
+			profiles[i] = store.add(specs[i].diametralPitch, specs[i].numTeeth, specs[i].pressureAngle,
+				computeToothProfile(specs[i].diametralPitch, specs[i].numTeeth, specs[i].pressureAngle));
+		}
+	}
+
+	// The store keeps nominal teeth; each spec is offset for its process.
+	std::vector<ToothProfile> adjusted(specs.size());
+	std::vector<char> fits(specs.size(), 1);
+	parallelFor(specs.size(), [&](size_t i)
+	{
+		if (specs[i].isGear)
+		{
+			fits[i] = applyProcessTolerance(*profiles[i], *specs[i].process, adjusted[i]);
+			profiles[i] = &adjusted[i];
+		}
+	}, 16, jobs);
+
+	// Every spec is generated on its own core and written out in order.
+	std::vector<std::string> outputs(specs.size());
+	std::vector<char> ok(specs.size(), 0);
+	parallelFor(specs.size(), [&](size_t i)
+	{
+		if (fits[i])
+			ok[i] = generate(specs[i], profiles[i], format, jobs, outputs[i]);
+		else
+			outputs[i] = "process offset leaves no tooth tip";
+	}, 1, jobs);
+
+	const char* extension = (format == MeshFormat) ? ".stl" : ".dxf";
+	for (size_t i = 0; i < specs.size(); ++i)
+	{
+		if (!ok[i])
+		{
+			std::cerr << "spec " << (i + 1) << ": " << outputs[i] << "\n";
+			status = 1;
+			continue;
+		}
+
+		if (format == ReportFormat)
+		{
+			std::cout << outputs[i];
+			continue;
+		}
+
+		char name[32];
+		snprintf(name, sizeof(name), "/spec_%04zu", i + 1);
+		std::string path = outDir + name + extension;
+		std::ofstream file(path.c_str(), std::ios::binary);
+		file << outputs[i];
+		if (!file)
+		{
+			std::cerr << "cannot write " << path << "\n";
+			status = 1;
+		}
+	}
+
+	return status;
+}
@@ -0,0 +1,259 @@
+#pragma once
+
+// Tooth geometry of involute gears, independent of Fusion.
+
+#include "Geometry2D.h"
+#include "InvoluteMath.h"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+// Calculate points along an involute curve.
+inline Point2 involutePoint(double baseCircleRadius, double distFromCenterToInvolutePoint)
+{
+	double l = sqrt(distFromCenterToInvolutePoint * distFromCenterToInvolutePoint - baseCircleRadius * baseCircleRadius);
+	Point2 point;
+	involuteRollPoint(baseCircleRadius, l / baseCircleRadius, point.x, point.y);
+	return point;
+}
+
+// Number of points sampled along each flank of a tooth.
+const int involutePointCount = 10;
+
+// Geometry of a single tooth centered on the X axis. Only the first flank
+// is stored, the second flank is its mirror about the X axis.
+struct ToothProfile
+{
+	double pitchDia;
+	double rootDiameter;
+	double baseCircleDiameter;
+	double outsideDia;
+	Point2 involute[involutePointCount];
+};
+
+// Pitch diameter of a gear. Meshing gears touch at their pitch circles.
+inline double pitchDiameter(int numTeeth, double diametralPitch)
+{
+	return (double)numTeeth / diametralPitch;
+}
+
+// Compute the tooth of a gear.
+inline ToothProfile computeToothProfile(double diametralPitch, int numTeeth, double pressureAngle)
+{
+	ToothProfile profile;
+
+	// Compute the various values for a gear.
+	profile.pitchDia = pitchDiameter(numTeeth, diametralPitch);
+	double dedendum = 0.0;
+	if (diametralPitch < (20 * (M_PI / 180)))
+		dedendum = 1.157 / diametralPitch;
+	else
+		dedendum = 1.25 / diametralPitch;
+	profile.rootDiameter = profile.pitchDia - 2 * dedendum;
+	profile.baseCircleDiameter = profile.pitchDia * cos(pressureAngle);
+	profile.outsideDia = (double)(numTeeth + 2) / diametralPitch;
+
+	// Calculate points along the involute curve.
+	double involuteIntersectionRadius = profile.baseCircleDiameter / 2.0;
+	double radiusStep = ((profile.outsideDia - involuteIntersectionRadius * 2) / 2) / (involutePointCount - 1);
+	for (int i = 0; i < involutePointCount; ++i)
+	{
+		profile.involute[i] = involutePoint(profile.baseCircleDiameter / 2.0, involuteIntersectionRadius);
+		involuteIntersectionRadius = involuteIntersectionRadius + radiusStep;
+	}
+
+	// Determine the angle between the X axis and a line between the origin of the curve
+	// and the intersection point between the involute and the pitch diameter circle.
+	double pitchPointAngle = involutePolarAngle(profile.baseCircleDiameter / 2.0, profile.pitchDia / 2.0);
+
+	// Determine the angle defined by the tooth thickness as measured at
+	// the pitch diameter circle.
+	double tooththicknessAngle = -(2 * M_PI) / (2 * numTeeth);
+
+	// Rotate the involute so the intersection point lies on the x axis.
+	double sinAngle, cosAngle;
+	sinCos(-pitchPointAngle + (tooththicknessAngle / 2), sinAngle, cosAngle);
+	for (Point2& involutePt : profile.involute)
+		rotate(involutePt.x, involutePt.y, sinAngle, cosAngle);
+
+	return profile;
+}
+
+// A tooth rotated about the gear axis.
+struct ToothSection
+{
+	double angle;
+	Point2 flank1[involutePointCount];
+	Point2 flank2[involutePointCount];
+};
+
+// Rotated sections of one base tooth. A section is only evaluated the first
+// time its angle is requested and is reused after that, so the mirrored half
+// of a herringbone gear costs nothing.
+class ToothSections
+{
+public:
+	// The base profile may live in the profile store mapping and is not copied.
+	explicit ToothSections(const ToothProfile& base) : base_(base) {}
+
+	const ToothProfile& base() const { return base_; }
+
+	const ToothSection& at(double angle)
+	{
+		auto it = cache_.find(angle);
+		if (it != cache_.end())
+			return it->second;
+
+		ToothSection& section = cache_[angle];
+		section.angle = angle;
+		double sinAngle, cosAngle;
+		sinCos(angle, sinAngle, cosAngle);
+		for (int i = 0; i < involutePointCount; ++i)
+		{
+			const Point2& pt = base_.involute[i];
+			section.flank1[i] = { pt.x * cosAngle - pt.y * sinAngle, pt.x * sinAngle + pt.y * cosAngle };
+			section.flank2[i] = { pt.x * cosAngle + pt.y * sinAngle, pt.x * sinAngle - pt.y * cosAngle };
+		}
+
+		return section;
+	}
+
+private:
+	const ToothProfile& base_;
+	std::map<double, ToothSection> cache_;
+};
+
+// Number of slices for a tooth twisted by twist radians, so that the lofted
+// flank stays within tolerance of the true helix at the outside radius.
+inline int helixSliceCount(double twist, double outsideRadius, double tolerance)
+{
+	const int maxSlices = 32;
+
+	// A chord spanning an angle step deviates from its arc by about r * step^2 / 8.
+	double maxStep = sqrt(8.0 * tolerance / outsideRadius);
+	int count = (int)ceil(fabs(twist) / maxStep);
+	return std::max(1, std::min(count, maxSlices));
+}
+
+enum GearType
+{
+	SpurGearType,
+	HelicalGearType,
+	HerringboneGearType
+};
+
+inline GearType gearTypeFromName(const std::string& name)
+{
+	if (name == "Helical")
+		return HelicalGearType;
+	if (name == "Herringbone")
+		return HerringboneGearType;
+	return SpurGearType;
+}
+
+// Rotation of each layer of a gear, bottom to top, and its height. A spur
+// gear is one straight layer; helical gears take one layer per slice, turning
+// by tan(helixAngle) / pitch radius per unit of height, and herringbone gears
+// turn back over their upper half.
+inline void gearLayers(GearType gearType, const ToothProfile& profile, double thickness, double helixAngle, double tolerance,
+	std::vector<double>& angles, std::vector<double>& heights)
+{
+	angles.clear();
+	heights.clear();
+	if (gearType == SpurGearType)
+	{
+		angles.push_back(0.0);
+		angles.push_back(0.0);
+		heights.push_back(0.0);
+		heights.push_back(thickness);
+		return;
+	}
+
+	bool herringbone = (gearType == HerringboneGearType);
+	double segmentHeight = herringbone ? thickness / 2 : thickness;
+	double segmentTwist = segmentHeight * tan(helixAngle) / (profile.pitchDia / 2);
+	int sliceCount = helixSliceCount(segmentTwist, profile.outsideDia / 2, tolerance);
+	int layerCount = herringbone ? 2 * sliceCount + 1 : sliceCount + 1;
+	for (int k = 0; k < layerCount; ++k)
+	{
+		int twistIndex = (k <= sliceCount) ? k : 2 * sliceCount - k;
+		angles.push_back(segmentTwist * twistIndex / sliceCount);
+		heights.push_back(segmentHeight * k / sliceCount);
+	}
+}
+
+// Closed outline of a whole gear turned by angle. The flanks are the sampled
+// involute points and every tip and root arc gets arcSegments - 1 points in
+// between, so the outline is counterclockwise and star shaped around the origin.
+inline Polygon2 gearOutline(const ToothProfile& profile, int numTeeth, double angle, int arcSegments)
+{
+	double rootRadius = profile.rootDiameter / 2;
+	double outsideRadius = profile.outsideDia / 2;
+
+	// Lower flank of the unrotated tooth, from the root circle to the tip.
+	Polygon2 flank;
+	if (profile.baseCircleDiameter >= profile.rootDiameter)
+	{
+		double radius, rootAngle, s, c;
+		toPolar(profile.involute[0].x, profile.involute[0].y, radius, rootAngle);
+		sinCos(rootAngle, s, c);
+		flank.push_back({ rootRadius * c, rootRadius * s });
+	}
+	for (int i = 0; i < involutePointCount; ++i)
+	{
+		const Point2& pt = profile.involute[i];
+		double r = sqrt(pt.x * pt.x + pt.y * pt.y);
+		if (r < rootRadius)
+			continue;
+
+		// The involute starts inside the root circle, so begin where it leaves it.
+		if (flank.empty() && i > 0)
+		{
+			const Point2& prev = profile.involute[i - 1];
+			double prevR = sqrt(prev.x * prev.x + prev.y * prev.y);
+			double t = (rootRadius - prevR) / (r - prevR);
+			flank.push_back({ prev.x + (pt.x - prev.x) * t, prev.y + (pt.y - prev.y) * t });
+		}
+		flank.push_back(pt);
+	}
+
+	double tipAngle = atan2(flank.back().y, flank.back().x);
+	double rootAngle = atan2(flank.front().y, flank.front().x);
+	double pitchAngle = 2 * M_PI / numTeeth;
+
+	Polygon2 outline;
+	for (int k = 0; k < numTeeth; ++k)
+	{
+		double toothAngle = angle + pitchAngle * k;
+		double sinAngle, cosAngle;
+		sinCos(toothAngle, sinAngle, cosAngle);
+		auto add = [&](double x, double y) { outline.push_back({ x * cosAngle - y * sinAngle, x * sinAngle + y * cosAngle }); };
+
+		for (const Point2& pt : flank)
+			add(pt.x, pt.y);
+
+		// The tip arc runs symmetrically over the X axis.
+		for (int j = 1; j < arcSegments; ++j)
+		{
+			double s, c;
+			sinCos(tipAngle * (1.0 - 2.0 * j / arcSegments), s, c);
+			add(outsideRadius * c, outsideRadius * s);
+		}
+
+		// The upper flank is the mirror of the lower one.
+		for (size_t i = flank.size(); i-- > 0;)
+			add(flank[i].x, -flank[i].y);
+
+		// Root arc up to the lower flank of the next tooth.
+		for (int j = 1; j < arcSegments; ++j)
+		{
+			double s, c;
+			sinCos(-rootAngle + (pitchAngle + 2 * rootAngle) * j / arcSegments, s, c);
+			add(rootRadius * c, rootRadius * s);
+		}
+	}
+
+	return outline;
+}
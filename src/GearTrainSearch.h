@@ -0,0 +1,393 @@
+#pragma once
+
+// Search for compound spur gear trains that reach a target ratio.
+//
+// Each stage is a pinion driving a wheel; the wheel shares its shaft with the
+// pinion of the next stage. The ratio of a train is the product of
+// wheel / pinion teeth over its stages, and all gears share one diametral
+// pitch, so the center distance of a stage is the sum of the pitch radii.
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <math.h>
+
+#include "GearProfile.h"
+
+struct GearStage
+{
+	int pinionTeeth;
+	int wheelTeeth;
+};
+
+struct GearTrain
+{
+	std::vector<GearStage> stages;
+	double ratio;
+	double error; // relative to the target ratio
+	double size;  // sum of the center distances of the stages
+};
+
+struct GearTrainQuery
+{
+	double targetRatio = 1.0;
+	int minStages = 2;
+	int maxStages = 5;
+	int minTeeth = 8;
+	int maxTeeth = 120;
+	double diametralPitch = 7.62;
+	double maxCenterDistance = 0.0; // 0 for no limit
+	double maxError = 1e-6;         // relative error that counts as a match
+	size_t maxResults = 10;
+	size_t maxNodes = 20000000;     // partial trains to try before settling for the best so far
+};
+
+inline double stageCenterDistance(int pinionTeeth, int wheelTeeth, double diametralPitch)
+{
+	return (pitchDiameter(pinionTeeth, diametralPitch) + pitchDiameter(wheelTeeth, diametralPitch)) / 2;
+}
+
+// Trains that match within maxError come first, fewest parts then smallest.
+// The rest follow by ratio error.
+inline bool betterGearTrain(const GearTrain& a, const GearTrain& b, double maxError)
+{
+	bool aMatches = (a.error <= maxError);
+	bool bMatches = (b.error <= maxError);
+	if (aMatches != bMatches)
+		return aMatches;
+	if (!aMatches && a.error != b.error)
+		return a.error < b.error;
+	if (a.stages.size() != b.stages.size())
+		return a.stages.size() < b.stages.size();
+	if (a.size != b.size)
+		return a.size < b.size;
+	if (a.error != b.error)
+		return a.error < b.error;
+
+	// Equal on every count; order by teeth so the results do not depend on
+	// which thread found them first.
+	for (size_t i = 0; i < a.stages.size(); ++i)
+	{
+		if (a.stages[i].pinionTeeth != b.stages[i].pinionTeeth)
+			return a.stages[i].pinionTeeth < b.stages[i].pinionTeeth;
+		if (a.stages[i].wheelTeeth != b.stages[i].wheelTeeth)
+			return a.stages[i].wheelTeeth < b.stages[i].wheelTeeth;
+	}
+	return false;
+}
+
+// Branch and bound over the stages of a train. Stages are kept in order of
+// ratio, so every train is visited once whatever the order of its stages.
+// Subtrees are queued per thread; idle threads steal the oldest, largest
+// subtrees from the others.
+class GearTrainSearch
+{
+public:
+	explicit GearTrainSearch(const GearTrainQuery& query) : query_(query) {}
+
+	std::vector<GearTrain> run(size_t maxThreads = 0)
+	{
+		buildOptions();
+		results_.clear();
+		bound_ = Bound{ std::numeric_limits<double>::infinity(), query_.maxStages, std::numeric_limits<double>::infinity() };
+		boundVersion_ = 0;
+		nodeCount_ = 0;
+		if (options_.empty() || query_.targetRatio <= 0 || query_.maxResults == 0)
+			return results_;
+
+		size_t numThreads = std::max(1u, std::thread::hardware_concurrency());
+		if (maxThreads > 0)
+			numThreads = std::min(numThreads, maxThreads);
+		workers_ = std::vector<Worker>(numThreads);
+
+		// Search the shorter trains first. Once enough of them match, longer
+		// trains are cut off at the root.
+		for (int stageCount = query_.minStages; stageCount <= query_.maxStages; ++stageCount)
+		{
+			if (stageCount > currentBound().stages)
+				break;
+
+			pending_ = 1;
+			workers_[0].nodes.push_back(Node{ stageCount, std::vector<int>(), 1.0, 0.0 });
+
+			std::vector<std::thread> threads;
+			for (size_t i = 1; i < numThreads; ++i)
+				threads.emplace_back([this, i]() { work(i); });
+			work(0);
+			for (std::thread& thread : threads)
+				thread.join();
+		}
+
+		return results_;
+	}
+
+private:
+	// A stage with the fewest teeth for its ratio. Larger multiples of the
+	// same ratio are never better, so they are left out.
+	struct Option
+	{
+		double ratio;
+		double centerDistance;
+		int pinionTeeth;
+		int wheelTeeth;
+	};
+
+	// A partial train: the options of its first stages.
+	struct Node
+	{
+		int stageCount;
+		std::vector<int> stages;
+		double ratio;
+		double size;
+	};
+
+	// Limits a new train must beat to enter the results. Workers prune with
+	// copies, which can only be out of date on the loose side.
+	struct Bound
+	{
+		double error;
+		int stages;
+		double size;
+	};
+
+	struct Worker
+	{
+		std::mutex mutex;
+		std::deque<Node> nodes;
+		Bound bound;
+		unsigned boundVersion = ~0u;
+	};
+
+	static int gcd(int a, int b)
+	{
+		while (b)
+		{
+			int t = a % b;
+			a = b;
+			b = t;
+		}
+		return a;
+	}
+
+	void buildOptions()
+	{
+		options_.clear();
+		int minTeeth = std::max(1, query_.minTeeth);
+		for (int pinion = 1; pinion <= query_.maxTeeth; ++pinion)
+		{
+			for (int wheel = 1; wheel <= query_.maxTeeth; ++wheel)
+			{
+				if (gcd(pinion, wheel) != 1)
+					continue;
+
+				int multiple = (minTeeth + std::min(pinion, wheel) - 1) / std::min(pinion, wheel);
+				if (multiple * std::max(pinion, wheel) > query_.maxTeeth)
+					continue;
+
+				double centerDistance = stageCenterDistance(multiple * pinion, multiple * wheel, query_.diametralPitch);
+				if (query_.maxCenterDistance > 0 && centerDistance > query_.maxCenterDistance)
+					continue;
+
+				options_.push_back(Option{ (double)wheel / pinion, centerDistance, multiple * pinion, multiple * wheel });
+			}
+		}
+		std::sort(options_.begin(), options_.end(), [](const Option& a, const Option& b) { return a.ratio < b.ratio; });
+
+		minCenterDistance_ = std::numeric_limits<double>::infinity();
+		for (const Option& option : options_)
+			minCenterDistance_ = std::min(minCenterDistance_, option.centerDistance);
+	}
+
+	// First option at or after begin with a ratio of at least value.
+	size_t lowerOption(size_t begin, double value) const
+	{
+		return std::lower_bound(options_.begin() + begin, options_.end(), value,
+			[](const Option& option, double v) { return option.ratio < v; }) - options_.begin();
+	}
+
+	// First option at or after begin with a ratio above value.
+	size_t upperOption(size_t begin, double value) const
+	{
+		return std::upper_bound(options_.begin() + begin, options_.end(), value,
+			[](double v, const Option& option) { return v < option.ratio; }) - options_.begin();
+	}
+
+	Bound currentBound()
+	{
+		std::lock_guard<std::mutex> lock(resultsMutex_);
+		return bound_;
+	}
+
+	const Bound& workerBound(Worker& worker)
+	{
+		unsigned version = boundVersion_.load(std::memory_order_acquire);
+		if (version != worker.boundVersion)
+		{
+			worker.bound = currentBound();
+			worker.boundVersion = version;
+		}
+		return worker.bound;
+	}
+
+	void offer(const Node& node, size_t last)
+	{
+		GearTrain train;
+		for (int index : node.stages)
+			train.stages.push_back(GearStage{ options_[index].pinionTeeth, options_[index].wheelTeeth });
+		train.stages.push_back(GearStage{ options_[last].pinionTeeth, options_[last].wheelTeeth });
+
+		// The teeth products are exact in a double, so trains with the same
+		// ratio get the same error whatever the order of their stages.
+		double wheelProduct = 1.0;
+		double pinionProduct = 1.0;
+		for (const GearStage& stage : train.stages)
+		{
+			wheelProduct *= stage.wheelTeeth;
+			pinionProduct *= stage.pinionTeeth;
+		}
+		train.ratio = wheelProduct / pinionProduct;
+		train.error = fabs(train.ratio - query_.targetRatio) / query_.targetRatio;
+		train.size = node.size + options_[last].centerDistance;
+
+		std::lock_guard<std::mutex> lock(resultsMutex_);
+		double maxError = query_.maxError;
+		auto at = std::upper_bound(results_.begin(), results_.end(), train,
+			[maxError](const GearTrain& a, const GearTrain& b) { return betterGearTrain(a, b, maxError); });
+		if ((size_t)(at - results_.begin()) >= query_.maxResults)
+			return;
+		results_.insert(at, train);
+		if (results_.size() > query_.maxResults)
+			results_.pop_back();
+
+		if (results_.size() == query_.maxResults)
+		{
+			const GearTrain& worst = results_.back();
+			if (worst.error <= maxError)
+				bound_ = Bound{ maxError, (int)worst.stages.size(), worst.size };
+			else
+				bound_ = Bound{ worst.error, query_.maxStages, std::numeric_limits<double>::infinity() };
+			boundVersion_.fetch_add(1, std::memory_order_release);
+		}
+	}
+
+	void push(size_t self, Node&& node)
+	{
+		++pending_;
+		std::lock_guard<std::mutex> lock(workers_[self].mutex);
+		workers_[self].nodes.push_back(std::move(node));
+	}
+
+	// Take the newest node of our own queue, or else the oldest of another.
+	bool take(size_t self, Node& node)
+	{
+		for (size_t k = 0; k < workers_.size(); ++k)
+		{
+			Worker& worker = workers_[(self + k) % workers_.size()];
+			std::lock_guard<std::mutex> lock(worker.mutex);
+			if (worker.nodes.empty())
+				continue;
+			if (k == 0)
+			{
+				node = std::move(worker.nodes.back());
+				worker.nodes.pop_back();
+			}
+			else
+			{
+				node = std::move(worker.nodes.front());
+				worker.nodes.pop_front();
+			}
+			return true;
+		}
+		return false;
+	}
+
+	void work(size_t self)
+	{
+		Node node;
+		while (pending_.load() > 0)
+		{
+			if (!take(self, node))
+			{
+				std::this_thread::yield();
+				continue;
+			}
+			expand(self, node);
+			--pending_;
+		}
+	}
+
+	void expand(size_t self, const Node& node)
+	{
+		if (nodeCount_.fetch_add(1, std::memory_order_relaxed) >= query_.maxNodes)
+			return;
+
+		const Bound& bound = workerBound(workers_[self]);
+		int remaining = node.stageCount - (int)node.stages.size();
+
+		// Even the smallest stages would make the train too large.
+		if (node.stageCount > bound.stages)
+			return;
+		if (node.stageCount == bound.stages && node.size + remaining * minCenterDistance_ > bound.size)
+			return;
+
+		// Ratios the remaining stages must multiply to.
+		double low = 0.0;
+		double high = std::numeric_limits<double>::infinity();
+		if (bound.error < std::numeric_limits<double>::infinity())
+		{
+			low = query_.targetRatio * (1 - bound.error) / node.ratio;
+			high = query_.targetRatio * (1 + bound.error) / node.ratio;
+		}
+
+		size_t first = node.stages.empty() ? 0 : node.stages.back();
+		if (remaining == 1)
+		{
+			size_t end = upperOption(first, high);
+			for (size_t i = lowerOption(first, low); i < end; ++i)
+				offer(node, i);
+			return;
+		}
+
+		// The next stage has the smallest ratio of those left, so its power
+		// cannot exceed what is needed, and the others can at most multiply
+		// it by the largest ratio.
+		double largest = options_.back().ratio;
+		size_t begin = lowerOption(first, low / pow(largest, remaining - 1));
+		size_t end = upperOption(first, pow(high, 1.0 / remaining));
+		for (size_t i = begin; i < end; ++i)
+		{
+			Node child{ node.stageCount, node.stages, node.ratio * options_[i].ratio, node.size + options_[i].centerDistance };
+			child.stages.push_back((int)i);
+
+			// Queue the top of the tree so other threads can steal it; the
+			// last two stages are cheap and run in place.
+			if (child.stages.size() == 1 || remaining > 2)
+				push(self, std::move(child));
+			else
+				expand(self, child);
+		}
+	}
+
+	GearTrainQuery query_;
+	std::vector<Option> options_;
+	double minCenterDistance_ = 0.0;
+
+	std::vector<Worker> workers_;
+	std::atomic<size_t> pending_{ 0 };
+	std::atomic<size_t> nodeCount_{ 0 };
+
+	std::mutex resultsMutex_;
+	std::vector<GearTrain> results_;
+	Bound bound_;
+	std::atomic<unsigned> boundVersion_{ 0 };
+};
+
+// Best trains for a query, at most query.maxResults of them.
+inline std::vector<GearTrain> searchGearTrains(const GearTrainQuery& query, size_t maxThreads = 0)
+{
+	return GearTrainSearch(query).run(maxThreads);
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+// Plain 2D geometry shared by the add-ins and the command line generator.
+
+#ifndef _USE_MATH_DEFINES
+#define _USE_MATH_DEFINES
+#endif
+#include <math.h>
+
+#include <vector>
+
+struct Point2
+{
+	double x;
+	double y;
+};
+
+typedef std::vector<Point2> Polygon2;
+
+// Keep the part of a convex polygon where nx * x + ny * y <= c.
+inline Polygon2 clipHalfPlane(const Polygon2& poly, double nx, double ny, double c)
+{
+	Polygon2 result;
+	size_t n = poly.size();
+	for (size_t i = 0; i < n; ++i)
+	{
+		const Point2& a = poly[i];
+		const Point2& b = poly[(i + 1) % n];
+		double da = nx * a.x + ny * a.y - c;
+		double db = nx * b.x + ny * b.y - c;
+		if (da <= 0)
+			result.push_back(a);
+		if ((da < 0 && db > 0) || (da > 0 && db < 0))
+		{
+			double t = da / (da - db);
+			result.push_back({ a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t });
+		}
+	}
+
+	return result;
+}
+
+inline double polygonArea(const Polygon2& poly)
+{
+	double area = 0.0;
+	size_t n = poly.size();
+	for (size_t i = 0; i < n; ++i)
+	{
+		const Point2& a = poly[i];
+		const Point2& b = poly[(i + 1) % n];
+		area += a.x * b.y - b.x * a.y;
+	}
+
+	return area / 2.0;
+}
+
+// Shrink a convex polygon by moving every edge inwards by distance.
+inline Polygon2 insetConvex(const Polygon2& poly, double distance)
+{
+	double sign = (polygonArea(poly) > 0) ? 1.0 : -1.0;
+	Polygon2 result = poly;
+	size_t n = poly.size();
+	for (size_t i = 0; i < n && result.size() >= 3; ++i)
+	{
+		const Point2& a = poly[i];
+		const Point2& b = poly[(i + 1) % n];
+
+		// Outward normal of the edge.
+		double nx = (b.y - a.y) * sign;
+		double ny = -(b.x - a.x) * sign;
+		double len = sqrt(nx * nx + ny * ny);
+		if (len == 0.0)
+			continue;
+		nx /= len;
+		ny /= len;
+		result = clipHalfPlane(result, nx, ny, nx * a.x + ny * a.y - distance);
+	}
+
+	return (result.size() >= 3) ? result : Polygon2();
+}
+
+inline Polygon2 regularPolygon(double cx, double cy, double radius, int sides, double startAngle)
+{
+	Polygon2 poly;
+	for (int i = 0; i < sides; ++i)
+	{
+		double angle = startAngle + 2 * M_PI * i / sides;
+		poly.push_back({ cx + radius * cos(angle), cy + radius * sin(angle) });
+	}
+
+	return poly;
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+// Fast numerics for involute gears.
+//
+// The approximations are truncated series on reduced ranges, so their error
+// can be bounded by the first omitted term. Bounds are absolute and exclude
+// the final rounding, which adds a few ulps.
+
+#ifndef _USE_MATH_DEFINES
+#define _USE_MATH_DEFINES
+#endif
+#include <math.h>
+
+// sin and cos of the same angle, computed together where the compiler can.
+inline void sinCos(double angle, double& s, double& c)
+{
+#if defined(__GNUC__)
+	__builtin_sincos(angle, &s, &c);
+#else
+	s = sin(angle);
+	c = cos(angle);
+#endif
+}
+
+// sin and cos for the small angles found along a tooth flank. For |angle| <= 1
+// the Taylor series to x^15 and x^16 are off by at most 1/17! < 2.9e-15 and
+// 1/18! < 1.6e-16. Larger angles fall back to sinCos.
+inline void fastSinCos(double angle, double& s, double& c)
+{
+	if (fabs(angle) > 1.0)
+	{
+		sinCos(angle, s, c);
+		return;
+	}
+
+	double x2 = angle * angle;
+	s = angle * (1.0 + x2 * (-1.0 / 6 + x2 * (1.0 / 120 + x2 * (-1.0 / 5040 + x2 * (1.0 / 362880 +
+		x2 * (-1.0 / 39916800 + x2 * (1.0 / 6227020800.0 + x2 * (-1.0 / 1307674368000.0))))))));
+	c = 1.0 + x2 * (-1.0 / 2 + x2 * (1.0 / 24 + x2 * (-1.0 / 720 + x2 * (1.0 / 40320 + x2 * (-1.0 / 3628800 +
+		x2 * (1.0 / 479001600.0 + x2 * (-1.0 / 87178291200.0 + x2 * (1.0 / 20922789888000.0))))))));
+}
+
+// atan for x >= 0. The argument is reduced to |u| <= tan(pi / 12) < 0.268,
+// where the Taylor series to u^21 is off by at most 0.268^23 / 23 < 3.1e-15.
+inline double fastAtan(double x)
+{
+	const double tan15 = 0.26794919243112270; // 2 - sqrt(3)
+	const double sqrt3 = 1.73205080756887729;
+
+	bool inverted = (x > 1.0);
+	if (inverted)
+		x = 1.0 / x;
+
+	// atan(x) = pi / 6 + atan((sqrt(3) x - 1) / (x + sqrt(3)))
+	bool shifted = (x > tan15);
+	if (shifted)
+		x = (sqrt3 * x - 1.0) / (x + sqrt3);
+
+	double x2 = x * x;
+	double result = x * (1.0 + x2 * (-1.0 / 3 + x2 * (1.0 / 5 + x2 * (-1.0 / 7 + x2 * (1.0 / 9 + x2 * (-1.0 / 11 +
+		x2 * (1.0 / 13 + x2 * (-1.0 / 15 + x2 * (1.0 / 17 + x2 * (-1.0 / 19 + x2 * (1.0 / 21)))))))))));
+
+	if (shifted)
+		result += M_PI / 6;
+	if (inverted)
+		result = M_PI / 2 - result;
+
+	return result;
+}
+
+// The involute function inv(alpha) = tan(alpha) - alpha for 0 <= alpha < pi / 2.
+// Below 0.2 rad the tan series to alpha^15 is used, off by less than 1.0e-15;
+// above it tan - alpha no longer cancels badly and is evaluated directly.
+inline double involute(double alpha)
+{
+	if (alpha < 0.2)
+	{
+		double a2 = alpha * alpha;
+		return alpha * a2 * (1.0 / 3 + a2 * (2.0 / 15 + a2 * (17.0 / 315 + a2 * (62.0 / 2835 + a2 * (1382.0 / 155925 +
+			a2 * (21844.0 / 6081075 + a2 * (929569.0 / 638512875)))))));
+	}
+
+	double s, c;
+	sinCos(alpha, s, c);
+	return s / c - alpha;
+}
+
+// Pressure angle alpha with inv(alpha) = theta, for 0 <= theta <= 1.5.
+// The series inversion alpha = q - 2 q^3 / 15 + 3 q^5 / 175 with q = cbrt(3 theta)
+// seeds four Newton steps. The bound is on the returned angle: alpha is within
+// 3e-15 of the exact root over that whole range. The residual inv(alpha) - theta
+// is larger by the slope tan^2(alpha) and reaches about 2e-14 near theta = 1.5.
+inline double inverseInvolute(double theta)
+{
+	if (theta <= 0.0)
+		return 0.0;
+
+	double q = cbrt(3.0 * theta);
+	double alpha = q * (1.0 - q * q * (2.0 / 15 - q * q * (3.0 / 175)));
+	for (int i = 0; i < 4; ++i)
+	{
+		double t = tan(alpha);
+		alpha -= (t - alpha - theta) / (t * t);
+	}
+
+	return alpha;
+}
+
+// Radius and polar angle of a point, correct in every quadrant.
+inline void toPolar(double x, double y, double& radius, double& angle)
+{
+	radius = sqrt(x * x + y * y);
+	angle = atan2(y, x);
+}
+
+// Rotate the point (x, y) by the angle whose sin and cos are given.
+inline void rotate(double& x, double& y, double s, double c)
+{
+	double rx = x * c - y * s;
+	y = x * s + y * c;
+	x = rx;
+}
+
+// Point of the involute of a base circle after rolling off by angle t:
+// rb (cos t + t sin t, sin t - t cos t). This needs one sin and cos pair and
+// no inverse trigonometry. For t <= 2 they come from fastSinCos of t / 2 and
+// the double angle formulas, which at most double its error.
+inline void involuteRollPoint(double baseRadius, double t, double& x, double& y)
+{
+	double s, c;
+	if (t <= 2.0)
+	{
+		double hs, hc;
+		fastSinCos(t / 2, hs, hc);
+		s = 2 * hs * hc;
+		c = (hc - hs) * (hc + hs);
+	}
+	else
+		sinCos(t, s, c);
+
+	x = baseRadius * (c + t * s);
+	y = baseRadius * (s - t * c);
+}
+
+// Polar angle of the involute of a base circle at distance r from the center,
+// for r >= baseRadius. This is t - atan(t) with t = sqrt(r^2 - rb^2) / rb,
+// the same as inv(acos(rb / r)) without the acos.
+inline double involutePolarAngle(double baseRadius, double r)
+{
+	double t = sqrt(r * r - baseRadius * baseRadius) / baseRadius;
+	return t - fastAtan(t);
+}
+
+// Angular tooth thickness at radius r, given the angular thickness at the
+// pitch circle and the pressure angle there.
+inline double toothThicknessAngle(double baseRadius, double r, double pitchThicknessAngle, double pressureAngle)
+{
+	return pitchThicknessAngle + 2 * (involute(pressureAngle) - involutePolarAngle(baseRadius, r));
+}
+
+// Radius at which the flanks of a tooth meet and the tooth becomes pointed.
+inline double pointedToothRadius(double baseRadius, double pitchThicknessAngle, double pressureAngle)
+{
+	double alpha = inverseInvolute(pitchThicknessAngle / 2 + involute(pressureAngle));
+	return baseRadius / cos(alpha);
+}
@@ -0,0 +1,209 @@
+#pragma once
+
+// Lightening cutouts between the rings of a cylinder, independent of Fusion.
+
+#include "Geometry2D.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Lightening pattern between the inner and outer rings.
+enum LighteningPattern
+{
+	SpokePattern,
+	TrianglePattern,
+	HexPattern,
+	VoronoiPattern
+};
+
+inline LighteningPattern patternFromName(const std::string& name)
+{
+	if (name == "Triangle")
+		return TrianglePattern;
+	if (name == "Hex")
+		return HexPattern;
+	if (name == "Voronoi")
+		return VoronoiPattern;
+	return SpokePattern;
+}
+
+// Clip a convex cell to the band between two circles around the origin.
+// The inner circle is replaced by its tangent line facing the cell and the
+// outer one by an inscribed polygon, so the result always stays inside the band.
+inline Polygon2 clipToBand(const Polygon2& cell, double innerRadius, double outerRadius)
+{
+	double cx = 0.0, cy = 0.0;
+	for (const Point2& p : cell)
+	{
+		cx += p.x;
+		cy += p.y;
+	}
+	double len = sqrt(cx * cx + cy * cy);
+	if (cell.size() < 3 || len == 0.0)
+		return Polygon2();
+
+	Polygon2 result = clipHalfPlane(cell, -cx / len, -cy / len, -innerRadius);
+
+	const int outerSegments = 64;
+	double apothem = outerRadius * cos(M_PI / outerSegments);
+	for (int i = 0; i < outerSegments && result.size() >= 3; ++i)
+	{
+		double angle = 2 * M_PI * i / outerSegments;
+		result = clipHalfPlane(result, cos(angle), sin(angle), apothem);
+	}
+
+	return (result.size() >= 3) ? result : Polygon2();
+}
+
+// Centers of a triangular lattice with the given spacing covering a circle.
+inline std::vector<Point2> latticeCenters(double spacing, double radius)
+{
+	std::vector<Point2> centers;
+	double rowHeight = spacing * sqrt(3.0) / 2.0;
+	int rows = (int)ceil(radius / rowHeight) + 1;
+	int cols = (int)ceil(radius / spacing) + 1;
+	for (int j = -rows; j <= rows; ++j)
+	{
+		double offset = (j % 2 != 0) ? spacing / 2.0 : 0.0;
+		for (int i = -cols; i <= cols; ++i)
+			centers.push_back({ i * spacing + offset, j * rowHeight });
+	}
+
+	return centers;
+}
+
+// Compute the cutouts between innerRadius and outerRadius for a lattice or
+// Voronoi pattern, leaving at least minWall of material between neighbouring cells.
+inline std::vector<Polygon2> computeLighteningCells(LighteningPattern pattern, double innerRadius, double outerRadius, double cellSize, double minWall)
+{
+	std::vector<Polygon2> cells;
+	if (pattern == SpokePattern || cellSize <= 0 || outerRadius <= innerRadius)
+		return cells;
+
+	// Cells which are clipped down to slivers are not worth cutting.
+	double minArea = 0.1 * cellSize * cellSize;
+	double reach = outerRadius + cellSize;
+
+	if (pattern == TrianglePattern)
+	{
+		// Each lattice row holds one upward and one downward triangle per column.
+		double rowHeight = cellSize * sqrt(3.0) / 2.0;
+		double circumradius = cellSize / sqrt(3.0);
+		std::vector<Point2> bases = latticeCenters(cellSize, reach);
+		cells.resize(bases.size() * 2);
+		parallelFor(bases.size(), [&](size_t i)
+		{
+			const Point2& base = bases[i];
+			Polygon2 up = regularPolygon(base.x + cellSize / 2.0, base.y + rowHeight / 3.0, circumradius, 3, M_PI / 2);
+			Polygon2 down = regularPolygon(base.x + cellSize, base.y + 2 * rowHeight / 3.0, circumradius, 3, -M_PI / 2);
+			cells[2 * i] = clipToBand(insetConvex(up, minWall / 2.0), innerRadius, outerRadius);
+			cells[2 * i + 1] = clipToBand(insetConvex(down, minWall / 2.0), innerRadius, outerRadius);
+		});
+	}
+	else if (pattern == HexPattern)
+	{
+		std::vector<Point2> centers = latticeCenters(cellSize, reach);
+		cells.resize(centers.size());
+		parallelFor(centers.size(), [&](size_t i)
+		{
+			Polygon2 hex = regularPolygon(centers[i].x, centers[i].y, cellSize / sqrt(3.0), 6, M_PI / 2);
+			cells[i] = clipToBand(insetConvex(hex, minWall / 2.0), innerRadius, outerRadius);
+		});
+	}
+	else
+	{
+		// Jittered lattice seeds give evenly sized but irregular cells.
+		// The generator is seeded so the same spec always yields the same part.
+		std::vector<Point2> seeds;
+		std::mt19937 random(12345);
+		std::uniform_real_distribution<double> jitter(-0.35 * cellSize, 0.35 * cellSize);
+		for (const Point2& center : latticeCenters(cellSize, reach))
+		{
+			Point2 seed = { center.x + jitter(random), center.y + jitter(random) };
+			double r = sqrt(seed.x * seed.x + seed.y * seed.y);
+			if (r > innerRadius - cellSize && r < reach)
+				seeds.push_back(seed);
+		}
+
+		cells.resize(seeds.size());
+		parallelFor(seeds.size(), [&](size_t i)
+		{
+			const Point2& seed = seeds[i];
+
+			// Visit neighbours nearest first so the cell shrinks quickly
+			// and distant seeds can be skipped.
+			std::vector<std::pair<double, size_t>> neighbours;
+			for (size_t j = 0; j < seeds.size(); ++j)
+			{
+				if (j == i)
+					continue;
+				double dx = seeds[j].x - seed.x;
+				double dy = seeds[j].y - seed.y;
+				neighbours.push_back(std::make_pair(dx * dx + dy * dy, j));
+			}
+			std::sort(neighbours.begin(), neighbours.end());
+
+			Polygon2 cell = regularPolygon(seed.x, seed.y, 2 * cellSize, 4, M_PI / 4);
+			double cellRadius = 2 * cellSize;
+			for (const std::pair<double, size_t>& neighbour : neighbours)
+			{
+				double dist = sqrt(neighbour.first);
+				if ((dist - minWall) / 2.0 > cellRadius || cell.size() < 3)
+					break;
+
+				// Half plane of the bisector, pulled back by half a wall.
+				const Point2& other = seeds[neighbour.second];
+				double nx = (other.x - seed.x) / dist;
+				double ny = (other.y - seed.y) / dist;
+				double c = nx * (seed.x + other.x) / 2.0 + ny * (seed.y + other.y) / 2.0 - minWall / 2.0;
+				cell = clipHalfPlane(cell, nx, ny, c);
+
+				cellRadius = 0.0;
+				for (const Point2& p : cell)
+					cellRadius = std::max(cellRadius, sqrt((p.x - seed.x) * (p.x - seed.x) + (p.y - seed.y) * (p.y - seed.y)));
+			}
+			cells[i] = clipToBand(cell, innerRadius, outerRadius);
+		});
+	}
+
+	std::vector<Polygon2> result;
+	for (Polygon2& cell : cells)
+	{
+		if (fabs(polygonArea(cell)) >= minArea)
+			result.push_back(std::move(cell));
+	}
+
+	return result;
+}
+
+// Fraction of the ring width each spoke reaches into the rings.
+const double spokeRingOverlap = 0.1;
+
+// Spokes between the rings of a cylinder with rings of the given width, as
+// the add-in draws and patterns them. Each spoke reaches into both rings.
+// Widening moves only the long sides, so the ends stay inside the rings.
+inline std::vector<Polygon2> spokeOutlines(double innerRadius, double outerRadius, double ringWidth, int numSupport,
+	double widening = 0.0)
+{
+	double px = ringWidth / 2.0 + widening;
+	double py1 = innerRadius + (1.0 - spokeRingOverlap) * ringWidth;
+	double py2 = outerRadius - (1.0 - spokeRingOverlap) * ringWidth;
+
+	std::vector<Polygon2> result;
+	for (int k = 0; k < numSupport; ++k)
+	{
+		double angle = 2 * M_PI * k / numSupport;
+		double c = cos(angle);
+		double s = sin(angle);
+		Polygon2 spoke;
+		for (const Point2& pt : { Point2{ px, py1 }, Point2{ px, py2 }, Point2{ -px, py2 }, Point2{ -px, py1 } })
+			spoke.push_back({ pt.x * c - pt.y * s, pt.x * s + pt.y * c });
+		result.push_back(spoke);
+	}
+
+	return result;
+}
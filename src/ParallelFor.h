@@ -0,0 +1,36 @@
+#pragma once
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// Run func(i) for i in [0, count) on all cores, or on at most maxThreads.
+// Every thread gets at least minChunk items, so cheap loops stay serial.
+template <typename Func>
+void parallelFor(size_t count, const Func& func, size_t minChunk = 64, size_t maxThreads = 0)
+{
+	size_t numThreads = std::max(1u, std::thread::hardware_concurrency());
+	if (maxThreads > 0)
+		numThreads = std::min(numThreads, maxThreads);
+	numThreads = std::min(numThreads, (count + minChunk - 1) / minChunk);
+	if (numThreads <= 1)
+	{
+		for (size_t i = 0; i < count; ++i)
+			func(i);
+		return;
+	}
+
+	std::vector<std::thread> threads;
+	size_t chunk = (count + numThreads - 1) / numThreads;
+	for (size_t begin = 0; begin < count; begin += chunk)
+	{
+		size_t end = std::min(count, begin + chunk);
+		threads.emplace_back([&func, begin, end]()
+		{
+			for (size_t i = begin; i < end; ++i)
+				func(i);
+		});
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+}
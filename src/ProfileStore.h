@@ -0,0 +1,341 @@
+#pragma once
+
+#include "GearProfile.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <unordered_map>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// On-disk library of tooth profiles, shared between sessions and processes.
+// The file is a header followed by fixed size records which are only ever
+// appended, so every process maps it read-only and returns profiles straight
+// from the mapping. Appends are serialized by a file lock; readers take no lock
+// and only look at whole records with a valid checksum.
+class ProfileStore
+{
+public:
+	ProfileStore() {}
+	~ProfileStore() { close(); }
+
+	bool open(const std::string& path);
+	void close();
+
+	// Returns nullptr if the profile has not been stored yet.
+	const ToothProfile* find(double diametralPitch, int numTeeth, double pressureAngle);
+
+	// Store a new profile and return a copy which lives as long as the store.
+	const ToothProfile* add(double diametralPitch, int numTeeth, double pressureAngle, const ToothProfile& profile);
+
+private:
+	struct Header
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t recordSize;
+	};
+
+	struct Record
+	{
+		double diametralPitch;
+		double pressureAngle;
+		int32_t numTeeth;
+		uint32_t checksum;
+		ToothProfile profile;
+	};
+
+	struct Key
+	{
+		double diametralPitch;
+		int numTeeth;
+		double pressureAngle;
+
+		bool operator==(const Key& other) const
+		{
+			return diametralPitch == other.diametralPitch && numTeeth == other.numTeeth && pressureAngle == other.pressureAngle;
+		}
+	};
+
+	struct KeyHash
+	{
+		size_t operator()(const Key& key) const
+		{
+			size_t h = std::hash<double>()(key.diametralPitch);
+			h = h * 31 + std::hash<int>()(key.numTeeth);
+			h = h * 31 + std::hash<double>()(key.pressureAngle);
+			return h;
+		}
+	};
+
+	static uint32_t checksum(const Record& record);
+	bool lock();
+	void unlock();
+	bool append(const Record& record);
+	void buildIndex();
+
+	static const uint32_t version_ = 2;
+
+#ifdef _WIN32
+	HANDLE file_ = INVALID_HANDLE_VALUE;
+	HANDLE mapping_ = NULL;
+#else
+	int file_ = -1;
+#endif
+	const char* map_ = nullptr;
+	size_t mapSize_ = 0;
+	bool indexed_ = false;
+	std::unordered_map<Key, const ToothProfile*, KeyHash> index_;
+	std::deque<ToothProfile> added_;
+};
+
+inline bool ProfileStore::open(const std::string& path)
+{
+	close();
+	if (path.empty())
+		return false;
+
+	Header header = { { 'G', 'E', 'A', 'R', 'P', 'R', 'O', 'F' }, version_, (uint32_t)sizeof(Record) };
+
+#ifdef _WIN32
+	file_ = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+		NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file_ == INVALID_HANDLE_VALUE)
+		return false;
+#else
+	file_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+	if (file_ < 0)
+		return false;
+#endif
+
+	// The first process to get here writes the header.
+	if (!lock())
+	{
+		close();
+		return false;
+	}
+	size_t size = 0;
+#ifdef _WIN32
+	LARGE_INTEGER fileSize;
+	if (GetFileSizeEx(file_, &fileSize))
+		size = (size_t)fileSize.QuadPart;
+	DWORD written = 0;
+	if (size == 0 && WriteFile(file_, &header, sizeof(header), &written, NULL) && written == sizeof(header))
+		size = sizeof(header);
+#else
+	struct stat st;
+	if (fstat(file_, &st) == 0)
+		size = (size_t)st.st_size;
+	if (size == 0 && pwrite(file_, &header, sizeof(header), 0) == (ssize_t)sizeof(header))
+		size = sizeof(header);
+#endif
+	unlock();
+
+	if (size < sizeof(header))
+	{
+		close();
+		return false;
+	}
+
+#ifdef _WIN32
+	mapping_ = CreateFileMappingA(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping_)
+		map_ = (const char*)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+#else
+	void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, file_, 0);
+	if (map != MAP_FAILED)
+		map_ = (const char*)map;
+#endif
+	mapSize_ = size;
+
+	// A file written by another version is left alone.
+	const Header* stored = (const Header*)map_;
+	if (!map_ || memcmp(stored->magic, header.magic, sizeof(header.magic)) != 0 ||
+		stored->version != header.version || stored->recordSize != header.recordSize)
+	{
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+inline void ProfileStore::close()
+{
+#ifdef _WIN32
+	if (map_)
+		UnmapViewOfFile(map_);
+	if (mapping_)
+		CloseHandle(mapping_);
+	if (file_ != INVALID_HANDLE_VALUE)
+		CloseHandle(file_);
+	mapping_ = NULL;
+	file_ = INVALID_HANDLE_VALUE;
+#else
+	if (map_)
+		munmap((void*)map_, mapSize_);
+	if (file_ >= 0)
+		::close(file_);
+	file_ = -1;
+#endif
+	map_ = nullptr;
+	mapSize_ = 0;
+	indexed_ = false;
+	index_.clear();
+}
+
+inline uint32_t ProfileStore::checksum(const Record& record)
+{
+	// FNV-1a over the record with the checksum field cleared.
+	Record copy = record;
+	copy.checksum = 0;
+	const unsigned char* bytes = (const unsigned char*)&copy;
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < sizeof(copy); ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+inline bool ProfileStore::lock()
+{
+#ifdef _WIN32
+	// Lock a byte far past the data, so mapped reads are never blocked.
+	OVERLAPPED overlapped = {};
+	overlapped.OffsetHigh = 0x7FFFFFFF;
+	return LockFileEx(file_, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &overlapped) != FALSE;
+#else
+	return flock(file_, LOCK_EX) == 0;
+#endif
+}
+
+inline void ProfileStore::unlock()
+{
+#ifdef _WIN32
+	OVERLAPPED overlapped = {};
+	overlapped.OffsetHigh = 0x7FFFFFFF;
+	UnlockFileEx(file_, 0, 1, 0, &overlapped);
+#else
+	flock(file_, LOCK_UN);
+#endif
+}
+
+inline bool ProfileStore::append(const Record& record)
+{
+	if (!map_ || !lock())
+		return false;
+
+	// Write at the end of the last whole record, overwriting anything left
+	// behind by a writer which died half way through.
+	bool ok = false;
+#ifdef _WIN32
+	LARGE_INTEGER fileSize;
+	if (GetFileSizeEx(file_, &fileSize))
+	{
+		uint64_t size = (uint64_t)fileSize.QuadPart;
+		uint64_t offset = sizeof(Header) + (size - sizeof(Header)) / sizeof(Record) * sizeof(Record);
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = (DWORD)offset;
+		overlapped.OffsetHigh = (DWORD)(offset >> 32);
+		DWORD written = 0;
+		ok = WriteFile(file_, &record, sizeof(record), &written, &overlapped) && written == sizeof(record);
+	}
+#else
+	struct stat st;
+	if (fstat(file_, &st) == 0)
+	{
+		uint64_t size = (uint64_t)st.st_size;
+		uint64_t offset = sizeof(Header) + (size - sizeof(Header)) / sizeof(Record) * sizeof(Record);
+		ok = pwrite(file_, &record, sizeof(record), (off_t)offset) == (ssize_t)sizeof(record);
+	}
+#endif
+	unlock();
+
+	return ok;
+}
+
+inline void ProfileStore::buildIndex()
+{
+	indexed_ = true;
+	if (!map_)
+		return;
+
+	// Only records which were complete when the file was mapped are visible.
+	size_t count = (mapSize_ - sizeof(Header)) / sizeof(Record);
+	const Record* records = (const Record*)(map_ + sizeof(Header));
+	for (size_t i = 0; i < count; ++i)
+	{
+		const Record& record = records[i];
+		if (record.checksum != checksum(record))
+			continue;
+		Key key = { record.diametralPitch, record.numTeeth, record.pressureAngle };
+		index_.insert(std::make_pair(key, &record.profile));
+	}
+}
+
+inline const ToothProfile* ProfileStore::find(double diametralPitch, int numTeeth, double pressureAngle)
+{
+	if (!indexed_)
+		buildIndex();
+
+	Key key = { diametralPitch, numTeeth, pressureAngle };
+	auto it = index_.find(key);
+	return (it != index_.end()) ? it->second : nullptr;
+}
+
+inline const ToothProfile* ProfileStore::add(double diametralPitch, int numTeeth, double pressureAngle, const ToothProfile& profile)
+{
+	if (!indexed_)
+		buildIndex();
+
+	// Keep the profile for this session; the mapping does not grow with the file.
+	added_.push_back(profile);
+	const ToothProfile* added = &added_.back();
+	Key key = { diametralPitch, numTeeth, pressureAngle };
+	index_[key] = added;
+
+	Record record;
+	memset(&record, 0, sizeof(record));
+	record.diametralPitch = diametralPitch;
+	record.pressureAngle = pressureAngle;
+	record.numTeeth = numTeeth;
+	record.profile = profile;
+	record.checksum = checksum(record);
+	append(record);
+
+	return added;
+}
+
+// Location of the profile library. The version is part of the name, so
+// an incompatible build starts a library of its own.
+inline std::string profileStorePath()
+{
+	const char* path = getenv("GEAR_PROFILE_STORE");
+	if (path && *path)
+		return path;
+
+#ifdef _WIN32
+	const char* dir = getenv("APPDATA");
+	return dir ? std::string(dir) + "\\gear_profiles.v2.bin" : std::string();
+#else
+	const char* dir = getenv("HOME");
+	return dir ? std::string(dir) + "/.gear_profiles.v2.bin" : std::string();
+#endif
+}
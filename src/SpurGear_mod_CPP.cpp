@@ -1,10 +1,19 @@
 #include <Core/CoreAll.h>
 #include <Fusion/FusionAll.h>
 
+#include <algorithm>
 #include <sstream>
+#include <unordered_map>
+#include <vector>
 #define _USE_MATH_DEFINES
 #include <math.h>
 
+#include "DirectBody.h"
+#include "GearProfile.h"
+#include "GearTrainSearch.h"
+#include "ProfileStore.h"
+#include "ToleranceOffset.h"
+
 using namespace adsk::core;
 using namespace adsk::fusion;
 
@@ -35,20 +44,95 @@ namespace {
 		return cmDef;
 	}
 
-	// Calculate points along an involute curve.
-	Ptr<Point3D> involutePoint(double baseCircleRadius, double distFromCenterToInvolutePoint)
+	ProfileStore profileStore;
+
+	// Profile for a spec, from the library if it was computed before.
+	const ToothProfile& lookupToothProfile(double diametralPitch, int numTeeth, double pressureAngle)
 	{
-		double l = sqrt(distFromCenterToInvolutePoint * distFromCenterToInvolutePoint - baseCircleRadius * baseCircleRadius);
-		double alpha = l / baseCircleRadius;
-		double theta = alpha - acos(baseCircleRadius / distFromCenterToInvolutePoint);
+		const ToothProfile* profile = profileStore.find(diametralPitch, numTeeth, pressureAngle);
+		if (!profile)
+			profile = profileStore.add(diametralPitch, numTeeth, pressureAngle, computeToothProfile(diametralPitch, numTeeth, pressureAngle));
 
-		double x = distFromCenterToInvolutePoint * cos(theta);
-		double y = distFromCenterToInvolutePoint * sin(theta);
+		return *profile;
+	}
 
-		return Point3D::create(x, y, 0.0);
+	// Tooth for a spec offset for the process. The library keeps nominal
+	// teeth; the offset is cheap to redo. Returns false if no tooth is left.
+	bool processToothProfile(double diametralPitch, int numTeeth, double pressureAngle,
+		const ProcessTolerance& process, ToothProfile& profile)
+	{
+		return applyProcessTolerance(lookupToothProfile(diametralPitch, numTeeth, pressureAngle), process, profile);
+	}
+
+	// Whether a spec keeps its tooth after the process offset. The library is
+	// read but not added to, since validation and train candidates check specs
+	// which may never be built; only buildGear stores new profiles.
+	bool processToothFits(double diametralPitch, int numTeeth, double pressureAngle, const ProcessTolerance& process)
+	{
+		ToothProfile computed, profile;
+		const ToothProfile* nominal = profileStore.find(diametralPitch, numTeeth, pressureAngle);
+		if (!nominal)
+		{
+			computed = computeToothProfile(diametralPitch, numTeeth, pressureAngle);
+			nominal = &computed;
+		}
+		return applyProcessTolerance(*nominal, process, profile);
 	}
 
-	Ptr<ExtrudeFeature> createExtrude(Ptr<Profile> prof, double thickness)
+	// Draw one tooth section into a sketch lying at height z. The flanks are
+	// joined at the tip by an arc. With closeRoot the tooth is also closed
+	// across the root so it forms a profile by itself.
+	void drawTooth(Ptr<Sketch> sketch, const ToothProfile& profile, const ToothSection& section, double z, bool closeRoot)
+	{
+		Ptr<SketchCurves> curves = sketch->sketchCurves();
+		auto toSketch = [&](double x, double y) { return sketch->modelToSketchSpace(Point3D::create(x, y, z)); };
+
+		Ptr<ObjectCollection> involutePoints = ObjectCollection::create();
+		Ptr<ObjectCollection> involute2Points = ObjectCollection::create();
+		for (int i = 0; i < involutePointCount; ++i)
+		{
+			involutePoints->add(toSketch(section.flank1[i].x, section.flank1[i].y));
+			involute2Points->add(toSketch(section.flank2[i].x, section.flank2[i].y));
+		}
+
+		// Create the splines.
+		Ptr<SketchFittedSplines> splines = curves->sketchFittedSplines();
+		Ptr<SketchFittedSpline> spline1 = splines->add(involutePoints);
+		Ptr<SketchFittedSpline> spline2 = splines->add(involute2Points);
+
+		Ptr<SketchLines> lines = curves->sketchLines();
+		Ptr<Base> rootEnd1 = spline1->startSketchPoint();
+		Ptr<Base> rootEnd2 = spline2->startSketchPoint();
+		if (profile.baseCircleDiameter >= profile.rootDiameter)
+		{
+			// Extend the flanks radially down to the root circle.
+			double rootAngle = atan2(profile.involute[0].y, profile.involute[0].x);
+			double rootRadius = profile.rootDiameter / 2;
+
+			double s, c;
+			sinCos(rootAngle + section.angle, s, c);
+			Ptr<Point3D> rootPoint1 = toSketch(rootRadius * c, rootRadius * s);
+			rootEnd1 = lines->addByTwoPoints(rootPoint1, spline1->startSketchPoint())->startSketchPoint();
+
+			sinCos(-rootAngle + section.angle, s, c);
+			Ptr<Point3D> rootPoint2 = toSketch(rootRadius * c, rootRadius * s);
+			rootEnd2 = lines->addByTwoPoints(rootPoint2, spline2->startSketchPoint())->startSketchPoint();
+		}
+
+		double s, c;
+		sinCos(section.angle, s, c);
+		Ptr<Point3D> midPoint = toSketch((profile.outsideDia / 2) * c, (profile.outsideDia / 2) * s);
+
+		Ptr<SketchArcs> arcs = curves->sketchArcs();
+		arcs->addByThreePoints(spline1->endSketchPoint(), midPoint, spline2->endSketchPoint());
+
+		// The chord lies inside the root circle, so the tooth overlaps the root cylinder.
+		if (closeRoot)
+			lines->addByTwoPoints(rootEnd1, rootEnd2);
+	}
+
+	// prof is a single profile or an ObjectCollection of profiles.
+	Ptr<ExtrudeFeature> createExtrude(Ptr<Base> prof, double thickness)
 	{
 		if (!newComp)
 			return nullptr;
@@ -92,155 +176,301 @@ namespace {
 		circularPatterns->add(circularInput);
 	}
 
-	// Construct a gear.
-	void buildGear(double diametralPitch, int numTeeth, double pressureAngle, double thickness)
+	// Parameters which fully determine the geometry of a gear.
+	struct GearSpec
 	{
-		// Create new component
-		Ptr<Product> product = app->activeProduct();
-		Ptr<Design> design = product;
-		Ptr<Component> rootComp = design->rootComponent();
-		Ptr<Occurrences> allOccs = rootComp->occurrences();
-		Ptr<Occurrence> newOcc = allOccs->addNewComponent(Matrix3D::create());
-		newComp = newOcc->component();
-
-		// Create a new sketch.
-		Ptr<Sketches> sketches = newComp->sketches();
-		Ptr<ConstructionPlane> xyPlane = newComp->xYConstructionPlane();
-		Ptr<Sketch> sketch = sketches->add(xyPlane);
-		Ptr<SketchCurves> curves = sketch->sketchCurves();
-
-		// Compute the various values for a gear.
-		double pitchDia = (double)numTeeth / diametralPitch;
-		double dedendum = 0.0;
-		if (diametralPitch < (20 * (M_PI / 180)))
-			dedendum = 1.157 / diametralPitch;
-		else
-			dedendum = 1.25 / diametralPitch;
-		double rootDiameter = pitchDia - 2 * dedendum;
-		double baseCircleDiameter = pitchDia * cos(pressureAngle);
-		double outsideDia = (double)(numTeeth + 2) / diametralPitch;
-
-		// Calculate points along the involute curve.
-		int involutePointCount = 10;
-		double involuteIntersectionRadius = baseCircleDiameter / 2.0;
-		Ptr<ObjectCollection> involutePoints = ObjectCollection::create();
-		double radiusStep = ((outsideDia - involuteIntersectionRadius * 2) / 2) / (involutePointCount - 1);
-		for (int i = 0; i < involutePointCount; ++i)
+		double diametralPitch;
+		int numTeeth;
+		double pressureAngle;
+		double thickness;
+		GearType gearType;
+		double helixAngle;
+		double tolerance;
+		std::string process;
+		BuildMode buildMode;
+
+		bool operator==(const GearSpec& other) const
 		{
-			Ptr<Point3D> newPoint = involutePoint(baseCircleDiameter / 2.0, involuteIntersectionRadius);
-			involutePoints->add(newPoint);
-			involuteIntersectionRadius = involuteIntersectionRadius + radiusStep;
+			return diametralPitch == other.diametralPitch && numTeeth == other.numTeeth &&
+				pressureAngle == other.pressureAngle && thickness == other.thickness &&
+				gearType == other.gearType && helixAngle == other.helixAngle && tolerance == other.tolerance &&
+				process == other.process && buildMode == other.buildMode;
 		}
+	};
 
-		// Determine the angle between the X axis and a line between the origin of the curve
-		// and the intersection point between the involute and the pitch diameter circle.
-		Ptr<Point3D> pitchInvolutePoint = involutePoint(baseCircleDiameter / 2.0, pitchDia / 2.0);
-		double pitchPointAngle = atan(pitchInvolutePoint->y() / pitchInvolutePoint->x());
-
-		// Determine the angle defined by the tooth thickness as measured at
-		// the pitch diameter circle.
-		double tooththicknessAngle = -(2 * M_PI) / (2 * numTeeth);
-
-		// Rotate the involute so the intersection point lies on the x axis.
-		double cosAngle = cos(-pitchPointAngle + (tooththicknessAngle / 2));
-		double sinAngle = sin(-pitchPointAngle + (tooththicknessAngle / 2));
-		for (Ptr<Point3D> involutePt : involutePoints)
+	struct GearSpecHash
+	{
+		size_t operator()(const GearSpec& spec) const
 		{
-			involutePt->x(involutePt->x() * cosAngle - involutePt->y() * sinAngle);
-			involutePt->y(involutePt->x() * sinAngle + involutePt->y() * cosAngle);
+			size_t h = std::hash<double>()(spec.diametralPitch);
+			h = h * 31 + std::hash<int>()(spec.numTeeth);
+			h = h * 31 + std::hash<double>()(spec.pressureAngle);
+			h = h * 31 + std::hash<double>()(spec.thickness);
+			h = h * 31 + std::hash<int>()(spec.gearType);
+			h = h * 31 + std::hash<double>()(spec.helixAngle);
+			h = h * 31 + std::hash<double>()(spec.tolerance);
+			h = h * 31 + std::hash<std::string>()(spec.process);
+			h = h * 31 + std::hash<int>()(spec.buildMode);
+			return h;
 		}
+	};
 
-		// Create a new set of points with a negated y.  This effectively mirrors the original
-		// points about the X axis.
-		Ptr<ObjectCollection> involute2Points = ObjectCollection::create();
-		for (int i = 0; i < involutePointCount; ++i)
-		{
-			Ptr<Point3D> involutePt = involutePoints->item(i);
-			Ptr<Point3D> newPt = Point3D::create(involutePt->x(), -involutePt->y(), 0.0);
-			if (!newPt)
-				return;
-			involute2Points->add(newPt);
-		}
+	// Components already built, keyed by their spec.
+	std::unordered_map<GearSpec, Ptr<Component>, GearSpecHash> gearRegistry;
 
-		std::vector<double> curve1Dist, curve1Angle;
-		for (Ptr<Point3D> involutePt : involutePoints)
-		{
-			curve1Dist.push_back(sqrt(involutePt->x() * involutePt->x() + involutePt->y() * involutePt->y()));
-			curve1Angle.push_back(atan(involutePt->y() / involutePt->x()));
-		}
+	// Add an occurrence of an already built gear with the same spec.
+	// Returns false if there is no such gear in the design.
+	bool instanceGear(const GearSpec& spec, Ptr<Design> design, Ptr<Matrix3D> transform)
+	{
+		auto it = gearRegistry.find(spec);
+		if (it == gearRegistry.end())
+			return false;
 
-		std::vector<double> curve2Dist, curve2Angle;
-		for (Ptr<Point3D> involutePt : involute2Points)
+		// The component may have been deleted, or belong to another document.
+		Ptr<Component> comp = it->second;
+		if (!comp || !comp->isValid() || comp->parentDesign().get() != design.get())
 		{
-			curve2Dist.push_back(sqrt(involutePt->x() * involutePt->x() + involutePt->y() * involutePt->y()));
-			curve2Angle.push_back(atan(involutePt->y() / involutePt->x()));
+			gearRegistry.erase(it);
+			return false;
 		}
 
-		sketch->isComputeDeferred(true);
-		double angleDiff = -tooththicknessAngle * 2;
-
-		// Create the first spline.
-		Ptr<SketchFittedSplines> splines = curves->sketchFittedSplines();
-		Ptr<SketchFittedSpline> spline1 = splines->add(involutePoints);
-		Ptr<SketchFittedSpline> spline2 = splines->add(involute2Points);
+		Ptr<Occurrences> allOccs = design->rootComponent()->occurrences();
+		return allOccs->addExistingComponent(comp, transform) != nullptr;
+	}
 
-		double currentAngle = 0.0;
+	// Points on every tip and root arc of a gear built without features.
+	const int directArcSegments = 8;
 
-		Ptr<SketchLines> lines = curves->sketchLines();
-		if (baseCircleDiameter >= rootDiameter)
-		{
-			Ptr<Point3D> rootPoint1 = Point3D::create((rootDiameter / 2) * cos(curve1Angle[0] + currentAngle), (rootDiameter / 2) * sin(curve1Angle[0] + currentAngle), 0.0);
-			lines->addByTwoPoints(rootPoint1, spline1->startSketchPoint());
+	// Outline turns below this are within a flank or arc, which becomes one
+	// face. Those turn by at most 19 degrees per point, their corners by 36 or more.
+	const double directSmoothTurn = 25.0 * M_PI / 180;
 
-			Ptr<Point3D> rootPoint2 = Point3D::create((rootDiameter / 2) * cos(curve2Angle[0] + (currentAngle)), (rootDiameter / 2) * sin(curve2Angle[0] + (currentAngle)), 0);
-			lines->addByTwoPoints(rootPoint2, spline2->startSketchPoint());
-		}
+	std::string gearBodyName(const ToothProfile& profile)
+	{
+		std::stringstream ss;
+		ss << "Gear (" << profile.pitchDia << " pitch dia.)";
+		return ss.str();
+	}
 
-		Ptr<Point3D> midPoint = Point3D::create((outsideDia / 2) * cos(currentAngle), (outsideDia / 2) * sin(currentAngle), 0.0);
+	// Construct a gear. Helical and herringbone gears loft the tooth through
+	// rotated sections, spaced so the flank stays within tolerance. The tooth
+	// is offset for the manufacturing process before anything is drawn. In
+	// direct mode the gear is built as one B-rep body instead of timeline
+	// features; in compact mode a spur gear draws every tooth and needs no
+	// pattern. The timeline items of a new gear are grouped together.
+	// Returns false, without building anything, if the process offset leaves
+	// no tooth.
+	bool buildGear(double diametralPitch, int numTeeth, double pressureAngle, double thickness,
+		GearType gearType, double helixAngle, double tolerance, const ProcessTolerance& process,
+		BuildMode buildMode, Ptr<Matrix3D> transform)
+	{
+		Ptr<Product> product = app->activeProduct();
+		Ptr<Design> design = product;
 
-		Ptr<SketchArcs> arcs = curves->sketchArcs();
-		arcs->addByThreePoints(spline1->endSketchPoint(), midPoint, spline2->endSketchPoint());
+		// Reuse the component if the same gear was built before. A spur gear
+		// ignores the helix angle and accuracy, so they are left out of the
+		// key; otherwise the opposite hands of a train would never share a
+		// component.
+		bool spur = (gearType == SpurGearType);
+		GearSpec spec = { diametralPitch, numTeeth, pressureAngle, thickness, gearType,
+			spur ? 0.0 : helixAngle, spur ? 0.0 : tolerance, process.name, buildMode };
+		if (instanceGear(spec, design, transform))
+			return true;
 
-		currentAngle = angleDiff;
+		ToothProfile profile;
+		if (!processToothProfile(diametralPitch, numTeeth, pressureAngle, process, profile))
+			return false;
 
-		// Rotate the involute points for the next tooth.
-		for (int i = 0; i < involutePointCount; ++i)
+		// Create new component
+		int groupStart = timelineStart(design);
+		Ptr<Component> rootComp = design->rootComponent();
+		Ptr<Occurrences> allOccs = rootComp->occurrences();
+		Ptr<Occurrence> newOcc = allOccs->addNewComponent(transform);
+		newComp = newOcc->component();
+		auto finish = [&]()
 		{
-			Ptr<Point3D> involutePt = involutePoints->item(i);
-			involutePt->x(curve1Dist[i] * cos(curve1Angle[i] + currentAngle));
-			involutePt->y(curve1Dist[i] * sin(curve1Angle[i] + currentAngle));
+			gearRegistry[spec] = newComp;
+			groupTimeline(design, groupStart, gearBodyName(profile));
+		};
 
-			Ptr<Point3D> involute2Pt = involute2Points->item(i);
-			involute2Pt->x(curve2Dist[i] * cos(curve2Angle[i] + currentAngle));
-			involute2Pt->y(curve2Dist[i] * sin(curve2Angle[i] + currentAngle));
+		// Stack the gear outline through every helix layer. Each flank and arc
+		// is a spline face through the same points the sketches use.
+		if (buildMode == DirectBuildMode)
+		{
+			std::vector<double> angles, heights;
+			gearLayers(gearType, profile, thickness, helixAngle, tolerance, angles, heights);
+			std::vector<Polygon2> layers;
+			for (double angle : angles)
+				layers.push_back(gearOutline(profile, numTeeth, angle, directArcSegments));
+
+			Ptr<BRepBody> body = commitBody(newComp, layeredBody(layers, heights, directSmoothTurn));
+			if (body)
+				body->name(gearBodyName(profile));
+
+			finish();
+			return true;
 		}
 
+		ToothSections sections(profile);
+
+		// Create a new sketch.
+		Ptr<Sketches> sketches = newComp->sketches();
+		Ptr<ConstructionPlane> xyPlane = newComp->xYConstructionPlane();
+		Ptr<Sketch> sketch = sketches->add(xyPlane);
+		Ptr<SketchCurves> curves = sketch->sketchCurves();
 		Ptr<SketchCircles> circles = curves->sketchCircles();
-		circles->addByCenterRadius(Point3D::create(0.0, 0.0, 0.0), rootDiameter / 2);
 
-		sketch->isComputeDeferred(false);
+		Ptr<ExtrudeFeature> extOne;
+		Ptr<ObjectCollection> entities = ObjectCollection::create();
+		if (gearType == SpurGearType && buildMode == CompactBuildMode)
+		{
+			sketch->isComputeDeferred(true);
+			for (int k = 0; k < numTeeth; ++k)
+				drawTooth(sketch, profile, sections.at(2 * M_PI * k / numTeeth), 0.0, false);
+			circles->addByCenterRadius(Point3D::create(0.0, 0.0, 0.0), profile.rootDiameter / 2);
+			sketch->isComputeDeferred(false);
+
+			// Every region of the sketch is solid, so one extrusion makes the gear.
+			Ptr<ObjectCollection> profs = ObjectCollection::create();
+			for (Ptr<Profile> prof : sketch->profiles())
+				profs->add(prof);
+			extOne = createExtrude(profs, thickness);
+		}
+		else if (gearType == SpurGearType)
+		{
+			sketch->isComputeDeferred(true);
+			drawTooth(sketch, profile, sections.at(0.0), 0.0, false);
+			circles->addByCenterRadius(Point3D::create(0.0, 0.0, 0.0), profile.rootDiameter / 2);
+			sketch->isComputeDeferred(false);
+
+			// Create the extrusion.
+			Ptr<Profiles> profs = sketch->profiles();
 
-		// Create the extrusion.
-		Ptr<Profiles> profs = sketch->profiles();
+			Ptr<Profile> profOne = profs->item(0);
+			extOne = createExtrude(profOne, thickness);
 
-		Ptr<Profile> profOne = profs->item(0);
-		Ptr<ExtrudeFeature> extOne = createExtrude(profOne, thickness);
+			Ptr<Profile> profTwo = profs->item(1);
+			Ptr<ExtrudeFeature> extTwo = createExtrude(profTwo, thickness);
+			entities->add(extTwo);
+		}
+		else
+		{
+			// The root cylinder is a plain extrusion.
+			circles->addByCenterRadius(Point3D::create(0.0, 0.0, 0.0), profile.rootDiameter / 2);
+			extOne = createExtrude(sketch->profiles()->item(0), thickness);
+
+			// The sections follow the same layers as a direct build.
+			std::vector<double> angles, heights;
+			gearLayers(gearType, profile, thickness, helixAngle, tolerance, angles, heights);
+			int sectionCount = (int)angles.size();
+
+			// Draw the closed tooth sections from the bottom up.
+			Ptr<ConstructionPlanes> planes = newComp->constructionPlanes();
+			std::vector<Ptr<Profile>> toothProfs;
+			for (int k = 0; k < sectionCount; ++k)
+			{
+				Ptr<ConstructionPlane> plane = xyPlane;
+				if (k > 0)
+				{
+					Ptr<ConstructionPlaneInput> planeInput = planes->createInput();
+					planeInput->setByOffset(xyPlane, ValueInput::createByReal(heights[k]));
+					plane = planes->add(planeInput);
+				}
+
+				Ptr<Sketch> sectionSketch = sketches->add(plane);
+				sectionSketch->isComputeDeferred(true);
+				drawTooth(sectionSketch, profile, sections.at(angles[k]), heights[k], true);
+				sectionSketch->isComputeDeferred(false);
+				toothProfs.push_back(sectionSketch->profiles()->item(0));
+			}
 
-		Ptr<Profile> profTwo = profs->item(1);
-		Ptr<ExtrudeFeature> extTwo = createExtrude(profTwo, thickness);
+			// Loft each helical segment through its sections. A segment ends
+			// where the twist turns back, as in the middle of a herringbone gear.
+			Ptr<LoftFeatures> lofts = newComp->features()->loftFeatures();
+			int start = 0;
+			for (int k = 1; k < sectionCount; ++k)
+			{
+				bool turnsBack = (k + 1 < sectionCount) &&
+					((angles[k] - angles[k - 1]) * (angles[k + 1] - angles[k]) < 0);
+				if (!turnsBack && k + 1 < sectionCount)
+					continue;
+
+				Ptr<LoftFeatureInput> loftInput = lofts->createInput(FeatureOperations::JoinFeatureOperation);
+				Ptr<LoftSections> loftSections = loftInput->loftSections();
+				for (int i = start; i <= k; ++i)
+					loftSections->add(toothProfs[i]);
+				loftInput->isSolid(true);
+				entities->add(lofts->add(loftInput));
+				start = k;
+			}
+		}
 
 		// rotate copy tooth pattern
-		Ptr<ObjectCollection> entities = ObjectCollection::create();
-		entities->add(extTwo);
-		patternTeeth(entities, extOne, numTeeth);
+		if (entities->count() > 0)
+			patternTeeth(entities, extOne, numTeeth);
 
 		// Rename the body
 		Ptr<BRepFaces> faces = extOne->faces();
 		Ptr<BRepFace> face = faces->item(0);
 		Ptr<BRepBody> body = face->body();
-		std::stringstream ss;
-		ss << "Gear (" << pitchDia << " pitch dia.)";
-		body->name(ss.str());
+		body->name(gearBodyName(profile));
+
+		finish();
+		return true;
+	}
+
+	// Placement of a gear turned about its axis and moved to (x, y, z).
+	Ptr<Matrix3D> gearPlacement(double x, double y, double z, double angle)
+	{
+		Ptr<Matrix3D> transform = Matrix3D::create();
+		transform->setToRotation(angle, Vector3D::create(0.0, 0.0, 1.0), Point3D::create(0.0, 0.0, 0.0));
+		transform->translation(Vector3D::create(x, y, z));
+		return transform;
+	}
+
+	// Search for the best train for the query and build it along the x axis.
+	// Each wheel shares its shaft with the pinion of the next stage, which
+	// sits one gear thickness higher. The best train whose gears all keep
+	// their teeth after the process offset is built. Returns false if no
+	// train fits.
+	bool buildGearTrain(const GearTrainQuery& query, double pressureAngle, double thickness,
+		GearType gearType, double helixAngle, double tolerance, const ProcessTolerance& process, BuildMode buildMode)
+	{
+		auto fitsProcess = [&](const GearTrain& candidate)
+		{
+			for (const GearStage& stage : candidate.stages)
+			{
+				if (!processToothFits(query.diametralPitch, stage.pinionTeeth, pressureAngle, process) ||
+					!processToothFits(query.diametralPitch, stage.wheelTeeth, pressureAngle, process))
+					return false;
+			}
+			return true;
+		};
+
+		std::vector<GearTrain> trains = searchGearTrains(query);
+		auto best = std::find_if(trains.begin(), trains.end(), fitsProcess);
+		if (best == trains.end())
+			return false;
+
+		const GearTrain& train = *best;
+		double x = 0.0;
+		for (size_t i = 0; i < train.stages.size(); ++i)
+		{
+			const GearStage& stage = train.stages[i];
+			double z = i * thickness;
+			buildGear(query.diametralPitch, stage.pinionTeeth, pressureAngle, thickness,
+				gearType, helixAngle, tolerance, process, buildMode, gearPlacement(x, 0.0, z, 0.0));
+
+			// The pinion has a tooth on +x, so the wheel needs a gap on its -x
+			// side. With an even tooth count it is turned by half a pitch.
+			// Meshing helical gears have opposite hands.
+			x += stageCenterDistance(stage.pinionTeeth, stage.wheelTeeth, query.diametralPitch);
+			double wheelAngle = (stage.wheelTeeth % 2 == 0) ? M_PI / stage.wheelTeeth : 0.0;
+			buildGear(query.diametralPitch, stage.wheelTeeth, pressureAngle, thickness,
+				gearType, -helixAngle, tolerance, process, buildMode, gearPlacement(x, 0.0, z, wheelAngle));
+		}
+
+		return true;
 	}
 
 	bool isPureNumber(std::string str)
@@ -275,13 +505,32 @@ public:
 		Ptr<ValueCommandInput> pressureAngleInput = inputs->itemById("pressureAngle");
 		Ptr<StringValueCommandInput> numTeethInput = inputs->itemById("numTeeth");
 		Ptr<ValueCommandInput> thicknessInput = inputs->itemById("thickness");
+		Ptr<DropDownCommandInput> gearTypeInput = inputs->itemById("gearType");
+		Ptr<ValueCommandInput> helixAngleInput = inputs->itemById("helixAngle");
+		Ptr<ValueCommandInput> toleranceInput = inputs->itemById("tolerance");
+		Ptr<StringValueCommandInput> trainRatioInput = inputs->itemById("trainRatio");
+		Ptr<StringValueCommandInput> maxTeethInput = inputs->itemById("maxTeeth");
+		Ptr<StringValueCommandInput> maxStagesInput = inputs->itemById("maxStages");
+		Ptr<ValueCommandInput> maxCenterInput = inputs->itemById("maxCenter");
+		Ptr<DropDownCommandInput> processInput = inputs->itemById("process");
+		Ptr<DropDownCommandInput> buildModeInput = inputs->itemById("buildMode");
 
 		double diaPitch = 7.62;
 		double pressureAngle = 20.0 * (M_PI / 180);
 		int numTeeth = 24;
 		double thickness = 3.5;
-
-		if (!diaPitchInput || !pressureAngleInput || !numTeethInput || !thicknessInput)
+		GearType gearType = SpurGearType;
+		double helixAngle = 20.0 * (M_PI / 180);
+		double tolerance = 0.001;
+		double trainRatio = 0.0;
+		GearTrainQuery query;
+		const ProcessTolerance* process = &processPresets[0];
+		BuildMode buildMode = ParametricBuildMode;
+
+		if (!diaPitchInput || !pressureAngleInput || !numTeethInput || !thicknessInput ||
+			!gearTypeInput || !helixAngleInput || !toleranceInput ||
+			!trainRatioInput || !maxTeethInput || !maxStagesInput || !maxCenterInput ||
+			!processInput || !buildModeInput)
 		{
 			ui->messageBox("One of the inputs don't exist.");
 		}
@@ -297,9 +546,37 @@ public:
 				int num = atoi(numTeethValue.c_str());
 				numTeeth = (num > 0) ? num : numTeeth;
 			}
+
+			Ptr<ListItem> gearTypeItem = gearTypeInput->selectedItem();
+			if (gearTypeItem)
+				gearType = gearTypeFromName(gearTypeItem->name());
+			helixAngle = unitsMgr->evaluateExpression(helixAngleInput->expression(), "deg");
+			tolerance = unitsMgr->evaluateExpression(toleranceInput->expression(), "cm");
+
+			// With a train ratio the tooth count is the smallest allowed in the train.
+			trainRatio = atof(trainRatioInput->value().c_str());
+			query.targetRatio = trainRatio;
+			query.minTeeth = numTeeth;
+			query.maxTeeth = atoi(maxTeethInput->value().c_str());
+			query.maxStages = atoi(maxStagesInput->value().c_str());
+			query.diametralPitch = diaPitch;
+			query.maxCenterDistance = unitsMgr->evaluateExpression(maxCenterInput->expression(), "cm");
+
+			Ptr<ListItem> processItem = processInput->selectedItem();
+			if (processItem)
+				process = &processFromName(processItem->name());
+			Ptr<ListItem> buildModeItem = buildModeInput->selectedItem();
+			if (buildModeItem)
+				buildMode = buildModeFromName(buildModeItem->name());
 		}
 
-		buildGear(diaPitch, numTeeth, pressureAngle, thickness);
+		if (trainRatio > 0)
+		{
+			if (!buildGearTrain(query, pressureAngle, thickness, gearType, helixAngle, tolerance, *process, buildMode))
+				ui->messageBox("No gear train satisfies the constraints.");
+		}
+		else if (!buildGear(diaPitch, numTeeth, pressureAngle, thickness, gearType, helixAngle, tolerance, *process, buildMode, Matrix3D::create()))
+			ui->messageBox("The process offset leaves no tooth tip on this gear.");
 	}
 };
 
@@ -318,8 +595,18 @@ public:
 		Ptr<ValueCommandInput> pressureAngleInput = inputs->itemById("pressureAngle");
 		Ptr<StringValueCommandInput> numTeethInput = inputs->itemById("numTeeth");
 		Ptr<ValueCommandInput> thicknessInput = inputs->itemById("thickness");
-
-		if (!diaPitchInput || !pressureAngleInput || !numTeethInput || !thicknessInput)
+		Ptr<DropDownCommandInput> gearTypeInput = inputs->itemById("gearType");
+		Ptr<ValueCommandInput> helixAngleInput = inputs->itemById("helixAngle");
+		Ptr<ValueCommandInput> toleranceInput = inputs->itemById("tolerance");
+		Ptr<StringValueCommandInput> trainRatioInput = inputs->itemById("trainRatio");
+		Ptr<StringValueCommandInput> maxTeethInput = inputs->itemById("maxTeeth");
+		Ptr<StringValueCommandInput> maxStagesInput = inputs->itemById("maxStages");
+		Ptr<ValueCommandInput> maxCenterInput = inputs->itemById("maxCenter");
+		Ptr<DropDownCommandInput> processInput = inputs->itemById("process");
+
+		if (!diaPitchInput || !pressureAngleInput || !numTeethInput || !thicknessInput ||
+			!gearTypeInput || !helixAngleInput || !toleranceInput ||
+			!trainRatioInput || !maxTeethInput || !maxStagesInput || !maxCenterInput || !processInput)
 			return;
 
 		if (!app)
@@ -336,9 +623,32 @@ public:
 		{
 			numTeeth = atoi(numTeethValue.c_str());
 		}
-
+		Ptr<ListItem> gearTypeItem = gearTypeInput->selectedItem();
+		GearType gearType = gearTypeItem ? gearTypeFromName(gearTypeItem->name()) : SpurGearType;
+		double helixAngle = unitsMgr->evaluateExpression(helixAngleInput->expression(), "deg");
+		double tolerance = unitsMgr->evaluateExpression(toleranceInput->expression(), "cm");
+
+		// An empty train ratio builds a single gear.
+		std::string trainRatioValue = trainRatioInput->value();
+		double trainRatio = atof(trainRatioValue.c_str());
+		std::string maxTeethValue = maxTeethInput->value();
+		int maxTeeth = (!maxTeethValue.empty() && isPureNumber(maxTeethValue)) ? atoi(maxTeethValue.c_str()) : 0;
+		std::string maxStagesValue = maxStagesInput->value();
+		int maxStages = (!maxStagesValue.empty() && isPureNumber(maxStagesValue)) ? atoi(maxStagesValue.c_str()) : 0;
+		double maxCenter = unitsMgr->evaluateExpression(maxCenterInput->expression(), "cm");
+		Ptr<ListItem> processItem = processInput->selectedItem();
+		const ProcessTolerance& process = processFromName(processItem ? processItem->name() : "");
+
+		// For a train only the gear with the fewest teeth is checked here; the
+		// search skips trains with any other gear the offset does not fit.
 		if (numTeeth < 3 || diaPitch <= 0 || thickness <= 0 || pressureAngle < 0 || pressureAngle > M_PI * 30 / 180)
 			eventArgs->areInputsValid(false);
+		else if (gearType != SpurGearType && (helixAngle <= 0 || helixAngle > M_PI * 45 / 180 || tolerance <= 0))
+			eventArgs->areInputsValid(false);
+		else if (!trainRatioValue.empty() && (trainRatio <= 0 || maxTeeth < numTeeth || maxStages < 2 || maxStages > 5 || maxCenter < 0))
+			eventArgs->areInputsValid(false);
+		else if (!processToothFits(diaPitch, numTeeth, pressureAngle, process))
+			eventArgs->areInputsValid(false);
 		else
 			eventArgs->areInputsValid(true);
 	}
@@ -390,6 +700,39 @@ public:
 
 				Ptr<ValueInput> initialVal4 = ValueInput::createByReal(2.0);
 				inputs->addValueInput("thickness", "Gear Thickness", "cm", initialVal4);
+
+				Ptr<DropDownCommandInput> gearTypeInput = inputs->addDropDownCommandInput("gearType", "Gear Type", DropDownStyles::TextListDropDownStyle);
+				Ptr<ListItems> gearTypeItems = gearTypeInput->listItems();
+				gearTypeItems->add("Spur", true);
+				gearTypeItems->add("Helical", false);
+				gearTypeItems->add("Herringbone", false);
+
+				Ptr<ValueInput> initialVal5 = ValueInput::createByReal(20.0 * (M_PI / 180));
+				inputs->addValueInput("helixAngle", "Helix Angle", "deg", initialVal5);
+
+				Ptr<ValueInput> initialVal6 = ValueInput::createByReal(0.001);
+				inputs->addValueInput("tolerance", "Helix Accuracy", "cm", initialVal6);
+
+				// Searching for a train of gears instead of building one.
+				inputs->addStringValueInput("trainRatio", "Train Ratio", "");
+				inputs->addStringValueInput("maxTeeth", "Train Max Teeth", "120");
+				inputs->addStringValueInput("maxStages", "Train Max Stages", "5");
+
+				Ptr<ValueInput> initialVal7 = ValueInput::createByReal(0.0);
+				inputs->addValueInput("maxCenter", "Train Max Center Distance", "cm", initialVal7);
+
+				// Backlash, relief and kerf allowances of the manufacturing process.
+				Ptr<DropDownCommandInput> processInput = inputs->addDropDownCommandInput("process", "Process", DropDownStyles::TextListDropDownStyle);
+				Ptr<ListItems> processItems = processInput->listItems();
+				for (const ProcessTolerance& preset : processPresets)
+					processItems->add(preset.name, &preset == &processPresets[0]);
+
+				// Direct mode builds each gear as one body without parametric features.
+				Ptr<DropDownCommandInput> buildModeInput = inputs->addDropDownCommandInput("buildMode", "Build Mode", DropDownStyles::TextListDropDownStyle);
+				Ptr<ListItems> buildModeItems = buildModeInput->listItems();
+				buildModeItems->add("Parametric", true);
+				buildModeItems->add("Compact", false);
+				buildModeItems->add("Direct", false);
 			}
 		}
 	}
@@ -404,6 +747,9 @@ extern "C" XI_EXPORT bool run(const char* context)
 	app = Application::get();
 	ui = app->userInterface();;
 
+	// Map the library of previously computed tooth profiles.
+	profileStore.open(profileStorePath());
+
 	Ptr<Product> product = app->activeProduct();
 	Ptr<Design> design = product;
 
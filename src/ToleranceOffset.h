@@ -0,0 +1,379 @@
+#pragma once
+
+// Offsets for manufacturing processes, independent of Fusion.
+//
+// Outlines are offset to the right of their direction of travel, which is
+// outward for counterclockwise outlines. Offsetting towards the center of
+// curvature can fold an outline over itself, as near the base circle of an
+// involute; those folds are cut out again, so the result stays simple.
+
+#include "GearProfile.h"
+#include "Geometry2D.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Allowances of a manufacturing process, in cm.
+struct ProcessTolerance
+{
+	const char* name;
+	double flankBacklash; // removed from each tooth flank along its normal
+	double kerf;          // width of the cut; solids grow by half of it
+	double expansion;     // how much the process oversizes solids
+	double tipRelief;     // removed at the tip, ramping in over the outer half of the addendum
+	double rootRelief;    // extra depth below the root circle
+	double minFeature;    // narrowest wall the process makes reliably
+};
+
+const ProcessTolerance processPresets[] = {
+	{ "Nominal", 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 },
+	{ "FDM", 0.01, 0.0, 0.01, 0.01, 0.01, 0.04 },
+	{ "SLA", 0.005, 0.0, 0.003, 0.005, 0.005, 0.02 },
+	{ "Laser", 0.005, 0.015, 0.0, 0.0, 0.0, 0.02 },
+};
+
+const int processPresetCount = sizeof(processPresets) / sizeof(processPresets[0]);
+
+// The preset with the given name, or Nominal.
+inline const ProcessTolerance& processFromName(const std::string& name)
+{
+	for (const ProcessTolerance& process : processPresets)
+	{
+		if (name == process.name)
+			return process;
+	}
+	return processPresets[0];
+}
+
+// Distance every solid boundary moves outwards.
+inline double solidGrowth(const ProcessTolerance& process)
+{
+	return process.kerf / 2 - process.expansion;
+}
+
+// Whether a wall of the given nominal width, which the offset moves on both
+// sides, is still at least as wide as the process can make. Widths that only
+// miss it by rounding count as wide enough.
+inline bool wallHolds(double width, const ProcessTolerance& process)
+{
+	const double eps = 1e-9;
+	double offsetWidth = width + 2 * solidGrowth(process);
+	return offsetWidth > 0 && offsetWidth >= process.minFeature - eps;
+}
+
+inline bool segmentsIntersect(const Point2& a, const Point2& b, const Point2& c, const Point2& d, Point2& at)
+{
+	double rx = b.x - a.x, ry = b.y - a.y;
+	double sx = d.x - c.x, sy = d.y - c.y;
+	double denom = rx * sy - ry * sx;
+	if (denom == 0.0)
+		return false;
+
+	double t = ((c.x - a.x) * sy - (c.y - a.y) * sx) / denom;
+	double u = ((c.x - a.x) * ry - (c.y - a.y) * rx) / denom;
+	if (t < 0.0 || t > 1.0 || u < 0.0 || u > 1.0)
+		return false;
+
+	at = { a.x + t * rx, a.y + t * ry };
+	return true;
+}
+
+// Cut out the loops where an offset outline crosses itself. Of the two parts
+// of a closed outline on either side of a crossing, the one turning against
+// the outline is the fold.
+inline void removeLoops(Polygon2& poly, bool closed)
+{
+	bool found = true;
+	while (found && poly.size() > 3)
+	{
+		found = false;
+		size_t n = poly.size();
+		size_t segments = closed ? n : n - 1;
+		for (size_t i = 0; i < segments && !found; ++i)
+		{
+			for (size_t j = i + 2; j < segments && !found; ++j)
+			{
+				if (closed && i == 0 && j == n - 1)
+					continue;
+
+				Point2 at;
+				if (!segmentsIntersect(poly[i], poly[i + 1], poly[j], poly[(j + 1) % n], at))
+					continue;
+				found = true;
+
+				Polygon2 inner(poly.begin() + i + 1, poly.begin() + j + 1);
+				inner.insert(inner.begin(), at);
+				Polygon2 outer(poly.begin(), poly.begin() + i + 1);
+				outer.push_back(at);
+				outer.insert(outer.end(), poly.begin() + j + 1, poly.end());
+
+				bool keepInner = false;
+				if (closed)
+				{
+					bool positive = polygonArea(poly) > 0;
+					bool innerFolded = (polygonArea(inner) > 0) != positive;
+					bool outerFolded = (polygonArea(outer) > 0) != positive;
+					if (innerFolded != outerFolded)
+						keepInner = outerFolded;
+					else
+						keepInner = fabs(polygonArea(inner)) > fabs(polygonArea(outer));
+				}
+				poly = keepInner ? inner : outer;
+			}
+		}
+	}
+}
+
+// Offset a polyline by a distance per point. Every segment moves onto its
+// own offset line. Where neighbouring lines move apart, around the outside of
+// a corner, they are joined by an arc about the corner; where they cross,
+// they meet at their intersection. A segment that turns around under the
+// offset is dropped and its neighbours are extended to meet each other
+// instead, so the result keeps its distance from the whole original.
+// A closed outline that collapses entirely comes back empty.
+inline Polygon2 offsetPolyline(const Polygon2& line, const std::vector<double>& distances, bool closed)
+{
+	size_t n = line.size();
+	if (n < 2)
+		return line;
+
+	// Largest turn of an arc step; a miter over this much stays within 1%
+	// of the distance.
+	const double arcStep = M_PI / 12;
+
+	// A segment of the original with its offset line, through the offset of
+	// each end.
+	struct Segment
+	{
+		Point2 from, to;
+		Point2 offsetFrom, offsetTo;
+		double distanceFrom, distanceTo;
+	};
+
+	std::vector<Segment> segments;
+	size_t segmentCount = closed ? n : n - 1;
+	for (size_t i = 0; i < segmentCount; ++i)
+	{
+		const Point2& a = line[i];
+		const Point2& b = line[(i + 1) % n];
+		double len = sqrt((b.x - a.x) * (b.x - a.x) + (b.y - a.y) * (b.y - a.y));
+		if (len == 0)
+			continue;
+
+		double nx = (b.y - a.y) / len, ny = -(b.x - a.x) / len;
+		double da = distances[i], db = distances[(i + 1) % n];
+		segments.push_back({ a, b, { a.x + nx * da, a.y + ny * da }, { b.x + nx * db, b.y + ny * db }, da, db });
+	}
+
+	// Where the offset lines of two segments meet, or halfway between their
+	// ends when they are parallel.
+	auto join = [](const Segment& a, const Segment& b)
+	{
+		double rx = a.offsetTo.x - a.offsetFrom.x, ry = a.offsetTo.y - a.offsetFrom.y;
+		double sx = b.offsetTo.x - b.offsetFrom.x, sy = b.offsetTo.y - b.offsetFrom.y;
+		double denom = rx * sy - ry * sx;
+		if (fabs(denom) < 1e-12 * sqrt((rx * rx + ry * ry) * (sx * sx + sy * sy)))
+			return Point2{ (a.offsetTo.x + b.offsetFrom.x) / 2, (a.offsetTo.y + b.offsetFrom.y) / 2 };
+		double t = ((b.offsetFrom.x - a.offsetFrom.x) * sy - (b.offsetFrom.y - a.offsetFrom.y) * sx) / denom;
+		return Point2{ a.offsetFrom.x + t * rx, a.offsetFrom.y + t * ry };
+	};
+
+	// Vertex k starts segment k; an open polyline also has a last vertex.
+	auto vertices = [&]()
+	{
+		Polygon2 result;
+		size_t m = segments.size();
+		for (size_t k = 0; k < m; ++k)
+			result.push_back((!closed && k == 0) ? segments[0].offsetFrom : join(segments[(k + m - 1) % m], segments[k]));
+		if (!closed && m > 0)
+			result.push_back(segments.back().offsetTo);
+		return result;
+	};
+
+	// Drop reversed segments one at a time, the one that vanished at the
+	// smallest offset first: its offset length against its own length is
+	// the most negative.
+	Polygon2 result = vertices();
+	while (segments.size() > (closed ? 2u : 1u))
+	{
+		size_t m = segments.size();
+		size_t worst = m;
+		double worstRatio = 0;
+		for (size_t k = 0; k < m; ++k)
+		{
+			const Segment& segment = segments[k];
+			const Point2& a = result[k];
+			const Point2& b = result[(k + 1) % result.size()];
+			double ox = segment.to.x - segment.from.x, oy = segment.to.y - segment.from.y;
+			double ratio = (ox * (b.x - a.x) + oy * (b.y - a.y)) / (ox * ox + oy * oy);
+			if (ratio <= worstRatio)
+			{
+				worst = k;
+				worstRatio = ratio;
+			}
+		}
+		if (worst == m)
+			break;
+
+		// The end segment of an open polyline is cut back to where it met
+		// its neighbour, which becomes the new end.
+		if (!closed && worst == 0)
+			segments[1].offsetFrom = result[1];
+		else if (!closed && worst + 1 == m)
+			segments[worst - 1].offsetTo = result[worst];
+		segments.erase(segments.begin() + worst);
+		result = vertices();
+	}
+
+	if (closed && (result.size() < 3 || (polygonArea(result) > 0) != (polygonArea(line) > 0)))
+		return Polygon2();
+
+	// Round the outside of the corners that are still corners of the
+	// original.
+	Polygon2 rounded;
+	size_t m = segments.size();
+	for (size_t k = 0; k < result.size(); ++k)
+	{
+		if (closed || (k > 0 && k < m))
+		{
+			const Segment& a = segments[(k + m - 1) % m];
+			const Segment& b = segments[k % m];
+			double ax = a.to.x - a.from.x, ay = a.to.y - a.from.y;
+			double bx = b.to.x - b.from.x, by = b.to.y - b.from.y;
+			double turn = atan2(ax * by - ay * bx, ax * bx + ay * by);
+			bool adjacent = a.to.x == b.from.x && a.to.y == b.from.y;
+			if (adjacent && turn * a.distanceTo > 0 && fabs(turn) > arcStep)
+			{
+				int steps = int(ceil(fabs(turn) / arcStep));
+				double rx = a.offsetTo.x - a.to.x, ry = a.offsetTo.y - a.to.y;
+				for (int i = 0; i <= steps; ++i)
+				{
+					double c = cos(turn * i / steps), s = sin(turn * i / steps);
+					rounded.push_back({ a.to.x + rx * c - ry * s, a.to.y + rx * s + ry * c });
+				}
+				continue;
+			}
+		}
+		rounded.push_back(result[k]);
+	}
+
+	removeLoops(rounded, closed);
+	return rounded;
+}
+
+// Offset a closed outline by a constant distance.
+inline Polygon2 offsetPolygon(const Polygon2& poly, double distance)
+{
+	if (distance == 0.0)
+		return poly;
+	return offsetPolyline(poly, std::vector<double>(poly.size(), distance), true);
+}
+
+// Offset many outlines in parallel, dropping those that collapse.
+inline std::vector<Polygon2> offsetPolygons(const std::vector<Polygon2>& polys, double distance)
+{
+	if (distance == 0.0)
+		return polys;
+
+	std::vector<Polygon2> offsets(polys.size());
+	parallelFor(polys.size(), [&](size_t i)
+	{
+		offsets[i] = offsetPolygon(polys[i], distance);
+	}, 16);
+
+	std::vector<Polygon2> result;
+	for (Polygon2& poly : offsets)
+	{
+		if (!poly.empty())
+			result.push_back(std::move(poly));
+	}
+	return result;
+}
+
+// Points spaced evenly along a polyline, keeping both ends.
+inline Polygon2 resamplePolyline(const Polygon2& line, size_t count)
+{
+	std::vector<double> lengths(1, 0.0);
+	for (size_t i = 1; i < line.size(); ++i)
+		lengths.push_back(lengths.back() + sqrt((line[i].x - line[i - 1].x) * (line[i].x - line[i - 1].x) + (line[i].y - line[i - 1].y) * (line[i].y - line[i - 1].y)));
+
+	Polygon2 result;
+	size_t segment = 0;
+	for (size_t k = 0; k < count; ++k)
+	{
+		double target = lengths.back() * k / (count - 1);
+		while (segment + 2 < line.size() && lengths[segment + 1] < target)
+			++segment;
+		double span = lengths[segment + 1] - lengths[segment];
+		double t = (span > 0) ? (target - lengths[segment]) / span : 0.0;
+		result.push_back({ line[segment].x + (line[segment + 1].x - line[segment].x) * t,
+			line[segment].y + (line[segment + 1].y - line[segment].y) * t });
+	}
+	return result;
+}
+
+// Tooth adjusted for a process. The flank moves out with the solid, less the
+// backlash and tip relief; the tip and root circles move with the solid and
+// the root is deepened by the root relief. The flank is then resampled and
+// its end moved onto the new tip circle. Returns false if the offset leaves
+// no tooth: the flank collapses, crosses the middle of the tooth or misses
+// the tip circle, or the root circle vanishes.
+inline bool applyProcessTolerance(const ToothProfile& nominal, const ProcessTolerance& process, ToothProfile& result)
+{
+	result = nominal;
+	double growth = solidGrowth(process);
+	if (growth == 0.0 && process.flankBacklash == 0.0 && process.tipRelief == 0.0 && process.rootRelief == 0.0)
+		return true;
+
+	result.outsideDia = nominal.outsideDia + 2 * growth;
+	result.rootDiameter = nominal.rootDiameter + 2 * (growth - process.rootRelief);
+	if (result.rootDiameter <= 0)
+		return false;
+
+	double outsideRadius = nominal.outsideDia / 2;
+	double reliefStart = (nominal.pitchDia / 2 + outsideRadius) / 2;
+	Polygon2 flank(nominal.involute, nominal.involute + involutePointCount);
+	std::vector<double> distances;
+	for (const Point2& pt : flank)
+	{
+		double r = sqrt(pt.x * pt.x + pt.y * pt.y);
+		double ramp = std::max(0.0, std::min(1.0, (r - reliefStart) / (outsideRadius - reliefStart)));
+		distances.push_back(growth - process.flankBacklash - process.tipRelief * ramp);
+	}
+
+	Polygon2 offset = offsetPolyline(flank, distances, false);
+	if (offset.size() < 2)
+		return false;
+	if (offset.size() != (size_t)involutePointCount)
+		offset = resamplePolyline(offset, involutePointCount);
+
+	// Extend or trim the last segment to meet the tip circle.
+	Point2 a = offset[involutePointCount - 2];
+	Point2 b = offset[involutePointCount - 1];
+	double dx = b.x - a.x, dy = b.y - a.y;
+	double qa = dx * dx + dy * dy;
+	double qb = 2 * (a.x * dx + a.y * dy);
+	double qc = a.x * a.x + a.y * a.y - result.outsideDia * result.outsideDia / 4;
+	double disc = qb * qb - 4 * qa * qc;
+	if (qa <= 0 || disc < 0)
+		return false;
+
+	double t = (-qb + sqrt(disc)) / (2 * qa);
+	if (t <= 0)
+		return false;
+	offset[involutePointCount - 1] = { a.x + t * dx, a.y + t * dy };
+
+	// The other flank is the mirror image across the x axis, so the tooth is
+	// gone once this one reaches the axis.
+	bool above = flank[0].y > 0;
+	for (const Point2& pt : offset)
+	{
+		if ((pt.y > 0) != above || pt.y == 0.0)
+			return false;
+	}
+
+	std::copy(offset.begin(), offset.end(), result.involute);
+	return true;
+}